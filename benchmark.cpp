@@ -0,0 +1,701 @@
+#include "dataset.h"
+#include <random>
+
+// Runs the main data paths against a generated data set and prints one line
+// per benchmark: operations, wall time and throughput. With --csv the same
+// rows are written to a file so runs can be compared over time. Every run
+// with the same options works on byte-identical input.
+
+struct BenchResult {
+    string name;
+    size_t ops;
+    double seconds;
+    string note;
+};
+
+vector<BenchResult> benchResults;
+
+// library calls print progress for the console user; keep it out of the table
+class QuietCout {
+    public:
+    streambuf* old;
+    QuietCout() : old(cout.rdbuf(nullptr)) {}
+    ~QuietCout() { cout.rdbuf(old); }
+};
+
+class QuietCerr {
+    public:
+    streambuf* old;
+    QuietCerr() : old(cerr.rdbuf(nullptr)) {}
+    ~QuietCerr() { cerr.rdbuf(old); }
+};
+
+long rssKb() {
+    ifstream status("/proc/self/status");
+    string line;
+    while (getline(status, line))
+    if (line.rfind("VmRSS:", 0) == 0) return atol(line.c_str() + 6);
+    return 0;
+}
+
+template <class Fn>
+double timeIt(Fn&& fn) {
+    auto start = chrono::steady_clock::now();
+    {
+        QuietCout quiet;
+        fn();
+    }
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+void report(const string& name, size_t ops, double seconds, const string& note = "") {
+    benchResults.push_back({name, ops, seconds, note});
+    char line[160];
+    snprintf(line, sizeof line, "%-22s %10zu ops %10.4f s %14.0f ops/s", name.c_str(), ops, seconds, seconds > 0 ? ops / seconds : 0);
+    cout << line << (note.empty() ? "" : "  ") << note << "\n";
+}
+
+// nearest-rank p50 and p99 of per-operation latencies in microseconds
+string latencyNote(vector<double>& micros) {
+    if (micros.empty()) return "";
+    sort(micros.begin(), micros.end());
+    auto at = [&](double p) { return micros[max<size_t>(1, size_t(ceil(p * micros.size()))) - 1]; };
+    char note[80];
+    snprintf(note, sizeof note, "p50 %.1f us, p99 %.1f us", at(0.5), at(0.99));
+    return note;
+}
+
+string kib(long kb) {
+    return to_string(kb / 1024) + " MiB";
+}
+
+string mbPerSecond(uintmax_t bytes, double seconds) {
+    char note[32];
+    snprintf(note, sizeof note, "%.1f MB/s", seconds > 0 ? bytes / seconds / 1e6 : 0);
+    return note;
+}
+
+// The original grades_db.csv loader, kept as the baseline for
+// read_exam_results: getline per row, a stringstream per row and stof, into
+// a map of vectors keyed by the code string.
+map<string, vector<pair<string, float>>> readExamResultsLegacy(const string& filename) {
+    map<string, vector<pair<string, float>>> examResults;
+    ifstream inputFile(filename);
+    string line;
+    while (getline(inputFile, line)) {
+        stringstream ss(line);
+        string courseID, studentID, gradeStr;
+        if (getline(ss, courseID, ',') && getline(ss, studentID, ',') && getline(ss, gradeStr)) {
+            try {
+                examResults[courseID].emplace_back(studentID, stof(gradeStr));
+            } catch (const invalid_argument&) {
+                cerr << "Invalid grade in line: " << line << endl;
+            }
+        }
+    }
+    return examResults;
+}
+
+// The original exam lookup: every teacher's exam list in turn, comparing codes.
+vector<Question*>* findExamScan(vector<vector<pair<string, vector<Question*>>>>& teacherExams, const string& code) {
+    for (auto& exams : teacherExams)
+    for (auto& ex : exams)
+    if (ex.first == code) return &ex.second;
+    return nullptr;
+}
+
+// The original registration: the student's own list, then every teacher's
+// exams, both searched by code; nothing is journaled.
+bool registerLegacy(vector<string>& registered, const vector<vector<string>>& teacherCodes, const string& code) {
+    for (const auto& exam : registered)
+    if (exam == code) return false;
+    for (auto& codes : teacherCodes)
+    for (const auto& exam : codes)
+    if (exam == code) {
+        registered.push_back(code);
+        return true;
+    }
+    return false;
+}
+
+// The original report card, one student at a time: the score and every
+// figure found by walking all results, the header written and closed, then
+// the file reopened to copy the sheet in line by line.
+bool reportCardLegacy(const string& id, const string& name, const string& code, const vector<Question*>& questions,
+const vector<pair<string, float>>& results) {
+    ofstream out("reports/report_" + id + "_" + code + ".txt");
+    if (!out) return false;
+    float myScore = -1;
+    for (auto& p : results)
+    if (p.first == id) {
+        myScore = p.second;
+        break;
+    }
+    if (myScore < 0) return false;
+    float totalPositive = 0;
+    for (Question* q : questions) totalPositive += q->positiveMark;
+    float sum = 0, maxScore = 0;
+    int rank = 1;
+    for (auto& p : results) {
+        sum += p.second;
+        if (p.second > maxScore) maxScore = p.second;
+        if (p.second > myScore) rank++;
+    }
+    float avg = results.empty() ? 0 : sum / results.size();
+    out << "Karname baraye danesh-amooz " << name << " (ID: " << id << ")\n";
+    out << "Code azmon: " << code << "\n\n";
+    out << "Nomre shoma: " << myScore << " az " << totalPositive << "\n";
+    out << "Miyangin nomarat: " << avg << "\n";
+    out << "Bishine nomre: " << maxScore << "\n";
+    out << "Rotbe shoma: " << rank << " az " << results.size() << "\n\n";
+    out << "Joz'iyat soalat:\n";
+    out.close();
+
+    ifstream src(sheetPath(id, code));
+    ofstream dest("reports/report_" + id + "_" + code + ".txt", ios::app);
+    if (!src.is_open() || !dest.is_open()) return false;
+    string line;
+    while (getline(src, line)) dest << line << "\n";
+    return true;
+}
+
+// The original export: the whole list copied and sorted, and each row's name
+// found by walking every student.
+void exportLegacy(const string& code, const vector<pair<string, float>>& results) {
+    vector<pair<string, float>> list = results;
+    sort(list.begin(), list.end(), [](auto& a, auto& b) {
+        return a.second > b.second;
+    });
+    ofstream out("grades_" + code + ".txt");
+    float maxScore = 0, sum = 0;
+    out << "Liste Nomerat baraye azmon: " << code << "\n";
+    out << "---------------------------\n";
+    for (auto& entry : list) {
+        string studentName = "";
+        for (Student* s : students)
+        if (string_view(s->id) == entry.first)
+        studentName = string_view(s->name);
+        out << "Name: " << studentName << " | ID: " << entry.first << " | Nomre: " << entry.second << "\n";
+        if (entry.second > maxScore) maxScore = entry.second;
+        sum += entry.second;
+    }
+    float avg = list.empty() ? 0 : sum / list.size();
+    out << "---------------------------\n";
+    out << "Bishine nomre: " << maxScore << "\n";
+    out << "Miyangin nomarat: " << avg << "\n";
+}
+
+int main(int argc, char* argv[]) {
+    DatasetSpec spec;
+    string dir = (filesystem::temp_directory_path() / "exam-bench").string(), csv;
+    size_t batch = 0, enrollExams = 50, exportResults = 1000000, lookups = 1000000;
+    size_t matrixStudents = 100000, matrixQuestions = 200;
+    size_t threads = max(4u, thread::hardware_concurrency()), mixedOps = 400000, burst = 5000;
+    size_t importCount = 500, bankQuestions = 20000, journalOps = 2000;
+    size_t indexExams = 1000000, allocObjects = 1000000;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        string name = argv[i], value = argv[i + 1];
+        size_t n = strtoull(value.c_str(), nullptr, 10);
+        if (name == "--scale") {
+            if (!datasetPreset(value, spec)) {
+                cerr << "Scale-e " << value << " shenakhte nashod (small, medium, large).\n";
+                return 1;
+            }
+        } else if (name == "--dir") dir = value;
+        else if (name == "--csv") csv = value;
+        else if (name == "--batch") batch = n;
+        else if (name == "--enroll-exams") enrollExams = n;
+        else if (name == "--export-results") exportResults = n;
+        else if (name == "--lookups") lookups = n;
+        else if (name == "--matrix-students") matrixStudents = n;
+        else if (name == "--matrix-questions") matrixQuestions = n;
+        else if (name == "--threads") threads = max<size_t>(n, 1);
+        else if (name == "--mixed-ops") mixedOps = n;
+        else if (name == "--burst") burst = n;
+        else if (name == "--import-exams") importCount = n;
+        else if (name == "--bank-questions") bankQuestions = max<size_t>(n, 100);
+        else if (name == "--journal-ops") journalOps = n;
+        else if (name == "--index-exams") indexExams = n;
+        else if (name == "--alloc-objects") allocObjects = n;
+        else if (!datasetOption(name, value, spec)) {
+            cerr << "Gozine-ye " << name << " shenakhte nashod.\n";
+            return 1;
+        }
+    }
+    if (spec.exams() == 0 || spec.students == 0 || spec.questionsPerExam == 0) {
+        cerr << "Dataset bayad hadeaghal yek azmon, yek soal va yek danesh-amooz dashte bashad.\n";
+        return 1;
+    }
+    if (batch == 0) batch = spec.students;
+    enrollExams = min(enrollExams, spec.exams());
+
+    error_code ec;
+    filesystem::remove_all(dir, ec);
+    for (const char* sub : {"", "/sheets", "/reports", "/desc_answ"}) filesystem::create_directories(dir + sub, ec);
+    filesystem::path origin = filesystem::current_path();
+    filesystem::current_path(dir);
+
+    cout << "dataset: " << spec.teachers << " ostad, " << spec.exams() << " azmon x " << spec.questionsPerExam
+    << " soal, " << spec.students << " danesh-amooz, " << spec.results << " nomre, seed " << spec.seed
+    << "; metrics " << (EXAM_METRICS ? "on" : "off") << "; dir " << dir << "\n\n";
+
+    double seconds = timeIt([&] { writeDataset(spec, "."); });
+    report("generate", spec.students + spec.results, seconds);
+
+    // load and save
+    long before = rssKb();
+    seconds = timeIt([&] { loadData(teachers, students); });
+    report("load_text", teachers.size() + students.size(), seconds, "rss +" + kib(rssKb() - before));
+
+    seconds = timeIt([&] { saveData(teachers, students); });
+    report("save_snapshot", teachers.size() + students.size(), seconds);
+
+    // durable mutations: signup records appended to a journal that fsyncs
+    // after every record, every 8 records (the default) and every 64
+    BinaryWriter signup;
+    writeStudent(signup, students[0]);
+    for (size_t syncBatch : {size_t(1), size_t(8), size_t(64)}) {
+        Journal bench("bench.journal");
+        bench.syncBatch = syncBatch;
+        bench.open();
+        seconds = timeIt([&] {
+            for (size_t i = 0; i < journalOps; ++i) bench.append(JOURNAL_SIGNUP_STUDENT, signup);
+            bench.sync();
+        });
+        bench.close();
+        report("journal_sync_" + to_string(syncBatch), journalOps, seconds, to_string(filesystem::file_size("bench.journal", ec) / 1024) + " KiB");
+        filesystem::remove("bench.journal", ec);
+    }
+
+    size_t users = teachers.size() + students.size();
+    before = rssKb();
+    seconds = timeIt([&] { freeMemory(teachers, students); });
+    report("free_memory", users, seconds, "rss -" + kib(before - rssKb()));
+
+    before = rssKb();
+    seconds = timeIt([&] { loadData(teachers, students); });
+    report("load_snapshot", teachers.size() + students.size(), seconds, "rss +" + kib(rssKb() - before));
+    // what the lazy load left out: every exam's questions, decoded on first use
+    size_t decodedQuestions = 0;
+    before = rssKb();
+    seconds = timeIt([&] {
+        for (Teacher* t : teachers)
+        for (size_t i = 0; i < t->exams.size(); ++i) decodedQuestions += t->questionsOf(i).size();
+    });
+    report("load_snapshot_questions", decodedQuestions, seconds, "rss +" + kib(rssKb() - before));
+    dataArena.report(cout, "data");
+
+    uintmax_t gradesBytes = filesystem::file_size("grades_db.csv", ec);
+    before = rssKb();
+    seconds = timeIt([&] { examResults.assign(readExamResults("grades_db.csv")); });
+    report("read_exam_results", spec.results, seconds, mbPerSecond(gradesBytes, seconds) + ", rss +" + kib(rssKb() - before) + ", " + to_string(symbols.size()) + " symbols");
+    size_t legacyRows = 0;
+    seconds = timeIt([&] {
+        for (auto& exam : readExamResultsLegacy("grades_db.csv")) legacyRows += exam.second.size();
+    });
+    report("read_exam_results_old", legacyRows, seconds, mbPerSecond(gradesBytes, seconds) + ", getline/stof");
+
+    // startup as main does it (data and grades side by side) with the
+    // loaders' parallelFor limited to 1, 2, 4, ... threads
+    for (size_t t = 1; t <= threads; t *= 2) {
+        freeMemory(teachers, students);
+        parallelThreads = t;
+        seconds = timeIt([&] {
+            auto results = async(launch::async, readExamResults, "grades_db.csv");
+            loadData(teachers, students);
+            examResults.assign(results.get());
+        });
+        report("startup_" + to_string(t) + "_thread", teachers.size() + students.size() + spec.results, seconds);
+    }
+    parallelThreads = 0;
+
+    // lookups by the strings a user would type
+    vector<string> codes, ids;
+    for (size_t e = 0; e < spec.exams(); ++e) codes.push_back(datasetExamCode(e));
+    for (size_t s = 0; s < spec.students; ++s) ids.push_back(datasetStudentId(s));
+    size_t found = 0;
+    seconds = timeIt([&] {
+        for (size_t i = 0; i < lookups; ++i) found += findExam(codes[(i * 7919) % codes.size()]) != nullptr;
+    });
+    report("find_exam", lookups, seconds);
+
+    // the exam index against the original scan over every teacher's exams,
+    // at growing exam counts; exams are empty, spread 100 to a teacher
+    for (size_t n = 10000; n <= indexExams; n *= 10) {
+        ObjectArena indexArena;
+        vector<Teacher*> indexTeachers;
+        vector<vector<pair<string, vector<Question*>>>> teacherExams;
+        vector<string> indexCodes;
+        for (size_t e = 0; e < n; ++e) {
+            char code[24];
+            snprintf(code, sizeof code, "IX%07zu", e);
+            indexCodes.push_back(code);
+            if (e % 100 == 0) {
+                indexTeachers.push_back(indexArena.make<Teacher>("t", "IXT" + to_string(e / 100), "pw", vector<string>{}));
+                teacherExams.emplace_back();
+            }
+            indexTeachers.back()->exams.emplace_back(symbols.intern(code), vector<Question*>{});
+            teacherExams.back().emplace_back(code, vector<Question*>{});
+        }
+        rebuildExamIndex(indexTeachers);
+        seconds = timeIt([&] {
+            for (size_t i = 0; i < lookups; ++i) found += findExam(indexCodes[(i * 7919) % n]) != nullptr;
+        });
+        report("find_exam_" + to_string(n), lookups, seconds, "hashed index");
+        // each scan walks half the exams on average, so fewer of them
+        size_t scans = max<size_t>(20, 200000000 / n);
+        seconds = timeIt([&] {
+            for (size_t i = 0; i < scans; ++i) found += findExamScan(teacherExams, indexCodes[(i * 7919) % n]) != nullptr;
+        });
+        report("find_exam_scan_" + to_string(n), scans, seconds, "nested loops");
+    }
+    rebuildExamIndex(teachers);
+    seconds = timeIt([&] {
+        for (size_t i = 0; i < lookups; ++i) found += findUser(ids[(i * 7919) % ids.size()]) != nullptr;
+    });
+    report("find_user", lookups, seconds);
+    seconds = timeIt([&] {
+        for (size_t i = 0; i < lookups; ++i) {
+            Student* s = students[(i * 7919) % students.size()];
+            found += s->isRegistered(symbols.find(codes[i % codes.size()]));
+        }
+    });
+    report("is_registered", lookups, seconds, to_string(found) + " hits in all lookups");
+
+    // every student into enrollExams exams, then the same through the
+    // original per-student registration, starting from the same lists
+    vector<vector<string>> legacyRegistered(students.size()), teacherCodes;
+    for (size_t s = 0; s < students.size(); ++s)
+    for (Symbol e : students[s]->registeredExams) legacyRegistered[s].push_back(symbols.name(e));
+    for (Teacher* t : teachers) {
+        teacherCodes.emplace_back();
+        for (auto& ex : t->exams) teacherCodes.back().push_back(symbols.name(ex.first));
+    }
+    size_t enrolled = 0;
+    seconds = timeIt([&] {
+        for (size_t e = 0; e < enrollExams; ++e) enrolled += registerMany(symbols.find(codes[e]), students);
+    });
+    report("register_many", students.size() * enrollExams, seconds, to_string(enrolled) + " new");
+    enrolled = 0;
+    seconds = timeIt([&] {
+        for (size_t e = 0; e < enrollExams; ++e)
+        for (auto& registered : legacyRegistered) enrolled += registerLegacy(registered, teacherCodes, codes[e]);
+    });
+    report("register_many_old", students.size() * enrollExams, seconds, to_string(enrolled) + " new, linear scans");
+
+    // grading, reports and export on exam 0
+    writeSubmissions(spec, 0, batch, "submissions.tsv");
+    seconds = timeIt([&] { gradeBatch("submissions.tsv"); });
+    report("grade_batch", batch, seconds);
+
+    size_t written = 0;
+    seconds = timeIt([&] { written = generateAllReportCards(symbols.find(codes[0])); });
+    report("report_cards", written, seconds);
+    // the original path walks every result per student, so only a sample
+    vector<pair<string, float>> legacyResults;
+    examResults.read(symbols.find(codes[0]), [&](const ExamResults& results) {
+        for (auto& entry : results.entries) legacyResults.emplace_back(symbols.name(entry.first), entry.second);
+    });
+    vector<Question*>& reportQuestions = *findExam(symbols.find(codes[0]));
+    size_t sample = min<size_t>(legacyResults.size(), 2000);
+    written = 0;
+    seconds = timeIt([&] {
+        for (size_t i = 0; i < sample; ++i) {
+            const string& id = legacyResults[i * legacyResults.size() / max<size_t>(sample, 1)].first;
+            if (Student* s = dynamic_cast<Student*>(findUser(id)))
+            written += reportCardLegacy(id, string(s->name), codes[0], reportQuestions, legacyResults);
+        }
+    });
+    report("report_cards_old", written, seconds, to_string(sample) + " of " + to_string(legacyResults.size()) + " students");
+
+    Symbol big = symbols.intern("EXPORT-BENCH");
+    ExamResults bigResults;
+    for (size_t i = 0; i < exportResults; ++i)
+    bigResults.append(students[(i * 7919) % students.size()]->handle, float((i * 2654435761u) % 4001) / 100);
+    bigResults.buildRankIndex();
+    examResults.put(big, move(bigResults));
+    seconds = timeIt([&] { statsCache.get(big); });
+    report("stats_miss", 1, seconds);
+    seconds = timeIt([&] { for (int i = 0; i < 1000; ++i) statsCache.get(big); });
+    report("stats_hit", 1000, seconds);
+    seconds = timeIt([&] { exportExamGrades(big, 100); });
+    report("export_top100", exportResults, seconds);
+    seconds = timeIt([&] { exportExamGrades(big); });
+    report("export_full", exportResults, seconds);
+    // the original export looks every name up by walking all students, so
+    // it runs on the first 20000 results only
+    vector<pair<string, float>> legacyExport;
+    examResults.read(big, [&](const ExamResults& results) {
+        for (size_t i = 0; i < min<size_t>(results.entries.size(), 20000); ++i)
+        legacyExport.emplace_back(symbols.name(results.entries[i].first), results.entries[i].second);
+    });
+    seconds = timeIt([&] { exportLegacy("EXPORT-BENCH-OLD", legacyExport); });
+    report("export_full_old", legacyExport.size(), seconds, "full sort, name scan");
+
+    // bulk exam import into the first teacher, then the same file again,
+    // which must be rejected as a whole since every code is now taken
+    writeExamImport(spec, importCount, "exams_import.csv");
+    ImportReport imported, rejected;
+    seconds = timeIt([&] { imported = importExams(teachers[0], "exams_import.csv"); });
+    report("import_exams", imported.rows, seconds, to_string(imported.exams) + " exams, " + to_string(imported.errors.size()) + " errors");
+    seconds = timeIt([&] {
+        QuietCerr quiet;
+        rejected = importExams(teachers[0], "exams_import.csv");
+    });
+    report("import_rejected", rejected.rows, seconds, to_string(rejected.errors.size()) + " error lines, " + (rejected.committed ? "committed" : "nothing committed"));
+
+    // one exam taking mixedOps results one at a time, each followed by a rank
+    // lookup: the score treap against the sorted vector it replaced, where
+    // every insert shifted the scores above it
+    ExamResults oneExam;
+    uint64_t rankSum = 0;
+    seconds = timeIt([&] {
+        for (size_t i = 0; i < mixedOps; ++i) {
+            float score = float(mix64(i) % 40001) / 1000;
+            oneExam.add(Symbol(i), score);
+            rankSum += oneExam.rankOf(score);
+        }
+    });
+    report("results_add_rank", mixedOps, seconds, to_string(oneExam.scores.nodes.size()) + " distinct scores");
+    vector<float> sortedScores;
+    seconds = timeIt([&] {
+        for (size_t i = 0; i < mixedOps; ++i) {
+            float score = float(mix64(i) % 40001) / 1000;
+            sortedScores.insert(upper_bound(sortedScores.begin(), sortedScores.end(), score), score);
+            rankSum += 1 + (sortedScores.end() - upper_bound(sortedScores.begin(), sortedScores.end(), score));
+        }
+    });
+    report("results_add_rank_old", mixedOps, seconds, "sorted vector");
+
+    // inserts mixed with report lookups from several threads, first behind a
+    // single lock and then spread over the default shard count
+    vector<Symbol> examSyms;
+    for (auto& code : codes) examSyms.push_back(symbols.find(code));
+    for (size_t shardCount : {size_t(1), size_t(64)}) {
+        ResultStore store(shardCount);
+        atomic<uint64_t> checksum{0};
+        seconds = timeIt([&] {
+            vector<thread> workers;
+            for (size_t t = 0; t < threads; ++t)
+            workers.emplace_back([&, t] {
+                uint64_t x = t + 1, sum = 0;
+                for (size_t i = 0; i < mixedOps / threads; ++i) {
+                    x = x * 6364136223846793005ull + 1442695040888963407ull;
+                    Symbol exam = examSyms[(x >> 33) % examSyms.size()];
+                    Symbol student = students[(x >> 13) % students.size()]->handle;
+                    // one in four operations is a report
+                    if (x >> 62) {
+                        store.add(exam, student, float((x >> 40) % 4001) / 100);
+                        continue;
+                    }
+                    store.read(exam, [&](const ExamResults& results) {
+                        if (const float* score = results.scoreOf(student)) sum += results.rankOf(*score);
+                    });
+                }
+                checksum += sum;
+            });
+            for (thread& w : workers) w.join();
+        });
+        report("mixed_" + to_string(shardCount) + "_shard", mixedOps / threads * threads, seconds,
+        to_string(threads) + " threads, 25% reports");
+    }
+
+    // A deadline spike: burst exams on exam 0 finished back to back. Inline is
+    // what takeExam used to do before returning; through the pipeline the
+    // student only waits for submit(), and end to end runs until rendered.
+    vector<Question*> burstQuestions = *findExam(examSyms[0]);
+    auto makeSessions = [&] {
+        vector<unique_ptr<ExamSession>> sessions;
+        for (size_t i = 0; i < burst; ++i) {
+            sessions.push_back(make_unique<ExamSession>(codes[0], students[i % students.size()]->id, burstQuestions));
+            for (size_t q = 0; q < burstQuestions.size(); ++q) sessions.back()->record(q, to_string((i + q) % 4 + 1));
+        }
+        return sessions;
+    };
+    auto since = [](chrono::steady_clock::time_point start) {
+        return chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+    };
+
+    vector<unique_ptr<ExamSession>> sessions = makeSessions();
+    vector<double> inlineMicros, submitMicros, endToEndMicros;
+    seconds = timeIt([&] {
+        for (size_t i = 0; i < burst; ++i) {
+            auto start = chrono::steady_clock::now();
+            ExamSession& session = *sessions[i];
+            session.gradeAll();
+            gradeSink.replace(sheetPath(session.studentId, session.code), session.sheet());
+            string descAnswers = session.descriptiveAnswers();
+            if (!descAnswers.empty())
+            gradeSink.append("desc_answ/desc_" + session.studentId + "_" + session.code + ".txt", descAnswers);
+            examResults.add(examSyms[0], students[i % students.size()]->handle, session.total);
+            logExamResult(session.studentId, session.code, session.total);
+            inlineMicros.push_back(since(start));
+        }
+    });
+    report("burst_inline", burst, seconds, latencyNote(inlineMicros));
+
+    sessions = makeSessions();
+    uint64_t stalls = metrics.totals().counters[COUNTER_PIPELINE_STALLS];
+    submissions.onDone = [&](const SubmissionJob& job) { endToEndMicros.push_back(since(job.queued)); };
+    seconds = timeIt([&] {
+        for (size_t i = 0; i < burst; ++i) {
+            auto start = chrono::steady_clock::now();
+            submissions.submit({examSyms[0], students[i % students.size()]->handle, move(sessions[i]), {}});
+            submitMicros.push_back(since(start));
+        }
+        submissions.drain();
+    });
+    submissions.onDone = nullptr;
+    stalls = metrics.totals().counters[COUNTER_PIPELINE_STALLS] - stalls;
+    report("burst_submit", burst, seconds, latencyNote(submitMicros) + ", " + to_string(stalls) + " stalls");
+    report("burst_end_to_end", burst, seconds, latencyNote(endToEndMicros));
+
+    // option shuffles for a matrixQuestions-question MCQ exam across matrixStudents students
+    ObjectArena shuffleArena;
+    vector<Question*> mcqs;
+    for (size_t q = 0; q < matrixQuestions; ++q)
+    mcqs.push_back(shuffleArena.make<MultipleChoiceQuestion>("q", 1, 0.25f, vector<string>{"a", "b", "c", "d"}, int(q % 4)));
+    vector<QuestionState> states(mcqs.size());
+    size_t shown = 0;
+    seconds = timeIt([&] {
+        for (size_t s = 0; s < matrixStudents; ++s) {
+            uint64_t stream = shuffleStream(codes[0], ids[s % ids.size()]);
+            for (size_t q = 0; q < mcqs.size(); ++q) mcqs[q]->prepare(states[q], shuffleDraw(stream, q));
+            shown += states[s % states.size()].order;
+        }
+    });
+    report("option_shuffle", matrixStudents * matrixQuestions, seconds, to_string(matrixQuestions) + " questions");
+    // the original ask(): a generator seeded from random_device for every
+    // question shown, so a hundredth of the students
+    size_t legacyStudents = max<size_t>(matrixStudents / 100, 1);
+    seconds = timeIt([&] {
+        for (size_t s = 0; s < legacyStudents; ++s)
+        for (size_t q = 0; q < mcqs.size(); ++q) {
+            vector<int> indices = {0, 1, 2, 3};
+            mt19937 rng{random_device{}()};
+            shuffle(indices.begin(), indices.end(), rng);
+            shown += indices[0];
+        }
+    });
+    report("option_shuffle_old", legacyStudents * matrixQuestions, seconds, "random_device per question");
+
+    // per-student exams drawn from a bank a tenth the size and from the full
+    // one; assembling should cost the same for both
+    ExamBlueprint blueprint;
+    blueprint.count[0] = 20;
+    blueprint.count[1] = 8;
+    blueprint.count[2] = 2;
+    blueprint.totalMarks = 75;
+    for (size_t poolSize : {bankQuestions / 10, bankQuestions}) {
+        ObjectArena bankArena;
+        vector<Question*> pool;
+        for (size_t q = 0; q < poolSize; ++q) {
+            float mark = float(1 + q % 4);
+            if (q % 10 < 7) pool.push_back(bankArena.make<MultipleChoiceQuestion>("q", mark, 0.25f, vector<string>{"a", "b", "c", "d"}, int(q % 4)));
+            else if (q % 10 < 9) pool.push_back(bankArena.make<ShortAnswerQuestion>("q", mark, 0, "a"));
+            else pool.push_back(bankArena.make<DescriptiveQuestion>("q", mark, "a"));
+        }
+        unique_ptr<QuestionBank> bank;
+        double buildSeconds = timeIt([&] { bank = make_unique<QuestionBank>(pool, blueprint); });
+        size_t drawn = 0;
+        seconds = timeIt([&] {
+            for (size_t s = 0; s < matrixStudents; ++s)
+            drawn += bank->assemble(shuffleStream(codes[0], ids[s % ids.size()])).size();
+        });
+        char note[96];
+        snprintf(note, sizeof note, "bank of %zu, %zu drawn, indexed in %.1f ms", poolSize, drawn / max<size_t>(matrixStudents, 1), buildSeconds * 1e3);
+        report(poolSize == bankQuestions ? "assemble_exam_large" : "assemble_exam_small", matrixStudents, seconds, note);
+    }
+
+    // per-question grading of the same answers through the virtual
+    // Question::grade calls and through the flat ExamKey
+    vector<Question*>& gradeQuestions = *findExam(examSyms[0]);
+    vector<vector<string>> given(min<size_t>(matrixStudents, 20000));
+    for (size_t s = 0; s < given.size(); ++s)
+    for (size_t q = 0; q < gradeQuestions.size(); ++q) given[s].push_back(to_string((s + q) % 5));
+    size_t graded = given.size() * gradeQuestions.size();
+    double totalScore = 0;
+    seconds = timeIt([&] {
+        QuestionState state;
+        for (auto& answers : given)
+        for (size_t q = 0; q < gradeQuestions.size(); ++q) totalScore += gradeQuestions[q]->grade(answers[q], state);
+    });
+    char gradeNote[48];
+    snprintf(gradeNote, sizeof gradeNote, "%.1f ns/question", seconds * 1e9 / max<size_t>(graded, 1));
+    report("grade_virtual", graded, seconds, gradeNote);
+    ExamKey gradeKey(gradeQuestions);
+    seconds = timeIt([&] {
+        vector<uint8_t> hit;
+        vector<float> marks;
+        for (auto& answers : given) totalScore -= gradeKey.score(answers, hit, marks);
+    });
+    snprintf(gradeNote, sizeof gradeNote, "%.1f ns/question", seconds * 1e9 / max<size_t>(graded, 1));
+    report("grade_exam_key", graded, seconds, gradeNote);
+
+    // --alloc-objects questions made one by one on the heap, as before the
+    // arena, and then from an arena; rss is measured after making and after freeing
+    auto questionText = [](size_t i) { return "Soal " + to_string(i % 20 + 1) + " az azmon " + to_string(i / 20); };
+    {
+        vector<Question*> heap;
+        heap.reserve(allocObjects);
+        long start = rssKb();
+        seconds = timeIt([&] {
+            for (size_t i = 0; i < allocObjects; ++i)
+            heap.push_back(new MultipleChoiceQuestion(questionText(i), 1, 0.25f, {"a", "b", "c", "d"}, int(i % 4)));
+        });
+        long made = rssKb();
+        report("alloc_heap", allocObjects, seconds, "rss +" + kib(made - start));
+        seconds = timeIt([&] {
+            for (Question* q : heap) delete q;
+        });
+        report("free_heap", allocObjects, seconds, "rss -" + kib(made - rssKb()));
+    }
+    {
+        ObjectArena arena;
+        long start = rssKb();
+        seconds = timeIt([&] {
+            for (size_t i = 0; i < allocObjects; ++i)
+            arena.make<MultipleChoiceQuestion>(questionText(i), 1, 0.25f, vector<string>{"a", "b", "c", "d"}, int(i % 4));
+        });
+        long made = rssKb();
+        report("alloc_arena", allocObjects, seconds, "rss +" + kib(made - start));
+        seconds = timeIt([&] { arena.release(); });
+        report("free_arena", allocObjects, seconds, "rss -" + kib(made - rssKb()));
+    }
+
+    // the MCQ scoring kernel on its own
+    vector<uint8_t> answers(matrixStudents * matrixQuestions), keys(matrixQuestions);
+    vector<float> positive(matrixQuestions, 1), negative(matrixQuestions, 0.25f), totals(matrixStudents);
+    for (size_t i = 0; i < answers.size(); ++i) answers[i] = uint8_t((i * 2654435761u >> 7) % 5 == 4 ? 0xFF : (i * 2654435761u >> 7) % 4);
+    for (size_t q = 0; q < matrixQuestions; ++q) keys[q] = uint8_t(q % 4);
+    seconds = timeIt([&] {
+        scoreMcqMatrixScalar(answers.data(), keys.data(), 0, matrixStudents, matrixQuestions, positive.data(), negative.data(), totals.data());
+    });
+    report("mcq_matrix_scalar", matrixStudents, seconds, to_string(matrixQuestions) + " questions");
+    seconds = timeIt([&] {
+        scoreMcqMatrix(answers.data(), keys.data(), 0, matrixStudents, matrixQuestions, positive.data(), negative.data(), totals.data());
+    });
+    report("mcq_matrix", matrixStudents, seconds, to_string(matrixQuestions) + " questions");
+
+    // cost of one scoped timer; zero when built with EXAM_METRICS off
+    const size_t timerOps = 1000000;
+    seconds = timeIt([&] {
+        for (size_t i = 0; i < timerOps; ++i) {
+            METRIC_TIMER(TIMER_LOG_EXAM_RESULT);
+        }
+    });
+    report("metric_timer", timerOps, seconds);
+
+    seconds = timeIt([&] { freeMemory(teachers, students); });
+    report("free_memory_end", users, seconds);
+
+    if (!csv.empty()) {
+        filesystem::current_path(origin);
+        ofstream out(csv);
+        out << "name,ops,seconds,ops_per_second,note\n";
+        for (auto& r : benchResults)
+        out << r.name << "," << r.ops << "," << r.seconds << "," << (r.seconds > 0 ? r.ops / r.seconds : 0) << ",\"" << r.note << "\"\n";
+    }
+    return 0;
+}
@@ -0,0 +1,213 @@
+#include "dataset.h"
+
+// splitmix64: tiny, fast, and unlike the <random> distributions its output is
+// fixed by the algorithm rather than by the standard library in use
+class DatasetRng {
+    public:
+    uint64_t state;
+
+    DatasetRng(uint64_t seed, uint64_t stream) : state(seed ^ (stream + 1) * 0x9E3779B97F4A7C15ull) {}
+
+    uint64_t next() {
+        return mix64(state += 0x9E3779B97F4A7C15ull);
+    }
+
+    size_t below(size_t n) { return n ? next() % n : 0; }
+};
+
+// separate streams so e.g. changing the student count leaves the exams alone
+enum DatasetStream : uint64_t { STREAM_EXAMS = 1 << 20, STREAM_STUDENTS = 2 << 20, STREAM_RESULTS = 3 << 20, STREAM_SUBMISSIONS = 4 << 20 };
+
+bool datasetPreset(const string& scale, DatasetSpec& spec) {
+    if (scale == "small") spec = DatasetSpec();
+    else if (scale == "medium") {
+        spec.teachers = 50;
+        spec.examsPerTeacher = 10;
+        spec.questionsPerExam = 30;
+        spec.students = 20000;
+        spec.registrationsPerStudent = 8;
+        spec.results = 500000;
+    } else if (scale == "large") {
+        spec.teachers = 200;
+        spec.examsPerTeacher = 10;
+        spec.questionsPerExam = 40;
+        spec.students = 100000;
+        spec.registrationsPerStudent = 10;
+        spec.results = 1000000;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool datasetOption(const string& name, const string& value, DatasetSpec& spec) {
+    uint64_t n = strtoull(value.c_str(), nullptr, 10);
+    if (name == "--teachers") spec.teachers = n;
+    else if (name == "--exams-per-teacher") spec.examsPerTeacher = n;
+    else if (name == "--questions") spec.questionsPerExam = n;
+    else if (name == "--students") spec.students = n;
+    else if (name == "--registrations") spec.registrationsPerStudent = n;
+    else if (name == "--results") spec.results = n;
+    else if (name == "--seed") spec.seed = n;
+    else return false;
+    return true;
+}
+
+string datasetExamCode(size_t exam) {
+    char buf[32];
+    snprintf(buf, sizeof buf, "EX%06zu", exam);
+    return buf;
+}
+
+string datasetStudentId(size_t student) {
+    char buf[32];
+    snprintf(buf, sizeof buf, "S%07zu", student);
+    return buf;
+}
+
+string datasetTeacherId(size_t teacher) {
+    char buf[32];
+    snprintf(buf, sizeof buf, "T%05zu", teacher);
+    return buf;
+}
+
+// 70% MCQ, 20% short answer, 10% descriptive
+vector<Question*> buildExamQuestions(const DatasetSpec& spec, size_t exam, ObjectArena& arena) {
+    DatasetRng rng(spec.seed, STREAM_EXAMS + exam);
+    vector<Question*> questions;
+    for (size_t q = 0; q < spec.questionsPerExam; ++q) {
+        string text = "Soal " + to_string(q + 1) + " az azmon " + to_string(exam);
+        size_t kind = rng.below(10);
+        if (kind < 7) {
+            vector<string> opts = {"Gozine 1", "Gozine 2", "Gozine 3", "Gozine 4"};
+            float pos = 1 + rng.below(3);
+            float neg = rng.below(3) * 0.25f;
+            questions.push_back(arena.make<MultipleChoiceQuestion>(text, pos, neg, opts, int(rng.below(4))));
+        } else if (kind < 9) {
+            float pos = 1 + rng.below(3);
+            float neg = rng.below(2) * 0.5f;
+            questions.push_back(arena.make<ShortAnswerQuestion>(text, pos, neg, "javab" + to_string(rng.below(100))));
+        } else {
+            questions.push_back(arena.make<DescriptiveQuestion>(text, float(2 + rng.below(4)), "pasokh-e pishnahadi"));
+        }
+    }
+    return questions;
+}
+
+void buildDataset(const DatasetSpec& spec, vector<Teacher*>& teachers, vector<Student*>& students, ObjectArena& arena) {
+    const char* majors[] = {"computer", "math", "physics", "chemistry", "biology"};
+
+    for (size_t t = 0; t < spec.teachers; ++t) {
+        Teacher* teacher = arena.make<Teacher>("Teacher " + to_string(t), datasetTeacherId(t), "pw",
+        vector<string>{"Course " + to_string(2 * t), "Course " + to_string(2 * t + 1)});
+        for (size_t e = 0; e < spec.examsPerTeacher; ++e) {
+            size_t exam = t * spec.examsPerTeacher + e;
+            teacher->exams.push_back({symbols.intern(datasetExamCode(exam)), buildExamQuestions(spec, exam, arena)});
+        }
+        teachers.push_back(teacher);
+    }
+
+    size_t regs = min(spec.registrationsPerStudent, spec.exams());
+    for (size_t s = 0; s < spec.students; ++s) {
+        DatasetRng rng(spec.seed, STREAM_STUDENTS + s);
+        Student* student = arena.make<Student>("Student " + to_string(s), datasetStudentId(s), "pw", teachers, majors[rng.below(5)]);
+        // distinct exams, so the count is exact
+        student->reserveRegistrations(regs);
+        while (student->registeredExams.size() < regs)
+        student->restoreRegistration(symbols.intern(datasetExamCode(rng.below(spec.exams()))));
+        students.push_back(student);
+    }
+}
+
+bool writeDataset(const DatasetSpec& spec, const string& dir) {
+    vector<Teacher*> teachers;
+    vector<Student*> students;
+    ObjectArena arena;
+    buildDataset(spec, teachers, students, arena);
+    saveTextData(dir + "/data.txt", teachers, students);
+
+    ofstream out(dir + "/grades_db.csv", ios::binary);
+    if (!out) return false;
+    if (spec.exams() == 0 || spec.students == 0) return true;
+
+    DatasetRng rng(spec.seed, STREAM_RESULTS);
+    string buf;
+    for (size_t r = 0; r < spec.results; ++r) {
+        buf += datasetExamCode(rng.below(spec.exams()));
+        buf += ',';
+        buf += datasetStudentId(rng.below(spec.students));
+        buf += ',';
+        // grades in steps of 0.25 from 0 to 40
+        size_t quarters = rng.below(161);
+        buf += to_string(quarters / 4);
+        if (quarters % 4) buf += quarters % 4 == 2 ? ".5" : quarters % 4 == 1 ? ".25" : ".75";
+        buf += '\n';
+        if (buf.size() >= (1 << 20)) {
+            out.write(buf.data(), buf.size());
+            buf.clear();
+        }
+    }
+    out.write(buf.data(), buf.size());
+    return bool(out);
+}
+
+bool writeExamImport(const DatasetSpec& spec, size_t count, const string& path) {
+    ofstream out(path, ios::binary);
+    if (!out) return false;
+
+    // generated text has no commas or quotes, so nothing needs quoting
+    string buf = "code,type,text,positive,negative,answer\n";
+    for (size_t e = 0; e < count; ++e) {
+        ObjectArena arena;
+        size_t exam = spec.exams() + e;
+        string code = datasetExamCode(exam);
+        for (Question* q : buildExamQuestions(spec, exam, arena)) {
+            ostringstream row;
+            row << code << ',' << q->getType() << ',' << q->text << ',' << q->positiveMark << ',';
+            if (auto* mcq = dynamic_cast<MultipleChoiceQuestion*>(q)) {
+                row << q->negativeMark;
+                for (auto& option : mcq->options) row << ',' << option;
+                row << ',' << mcq->correctOptionIndex + 1;
+            } else if (auto* sa = dynamic_cast<ShortAnswerQuestion*>(q)) {
+                row << q->negativeMark << ',' << sa->correctAnswer;
+            } else {
+                row << static_cast<DescriptiveQuestion*>(q)->correctAnswer;
+            }
+            buf += row.str();
+            buf += '\n';
+        }
+        if (buf.size() >= (1 << 20)) {
+            out.write(buf.data(), buf.size());
+            buf.clear();
+        }
+    }
+    out.write(buf.data(), buf.size());
+    return bool(out);
+}
+
+bool writeSubmissions(const DatasetSpec& spec, size_t exam, size_t count, const string& path) {
+    ofstream out(path, ios::binary);
+    if (!out || spec.students == 0) return false;
+
+    ObjectArena arena;
+    vector<Question*> questions = buildExamQuestions(spec, exam, arena);
+    DatasetRng rng(spec.seed, STREAM_SUBMISSIONS + exam);
+    string code = datasetExamCode(exam), line;
+    for (size_t i = 0; i < count; ++i) {
+        line = code + '\t' + datasetStudentId(i % spec.students);
+        for (Question* q : questions) {
+            line += '\t';
+            if (auto* mcq = dynamic_cast<MultipleChoiceQuestion*>(q)) {
+                // sheets are graded unshuffled, so the position is the option index
+                line += to_string(rng.below(10) < 6 ? mcq->correctOptionIndex + 1 : int(rng.below(4)) + 1);
+            } else if (auto* sa = dynamic_cast<ShortAnswerQuestion*>(q)) {
+                line += rng.below(2) ? sa->correctAnswer : "nemidanam";
+            } else {
+                line += "pasokh-e daneshjoo " + to_string(i);
+            }
+        }
+        line += '\n';
+        out.write(line.data(), line.size());
+    }
+    return bool(out);
+}
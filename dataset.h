@@ -0,0 +1,43 @@
+#ifndef EXAM_DATASET_H
+#define EXAM_DATASET_H
+
+#include "examSystem.h"
+
+// Size of a synthetic data set. The same spec and seed always give the same
+// files, byte for byte, on every platform.
+struct DatasetSpec {
+    size_t teachers = 10;
+    size_t examsPerTeacher = 5;
+    size_t questionsPerExam = 20;
+    size_t students = 2000;
+    size_t registrationsPerStudent = 5;
+    size_t results = 50000;
+    uint64_t seed = 1;
+
+    size_t exams() const { return teachers * examsPerTeacher; }
+};
+
+// presets for --scale: "small", "medium" or "large"
+bool datasetPreset(const string& scale, DatasetSpec& spec);
+
+// applies a "--name value" pair to the spec; false if the name isn't a spec field
+bool datasetOption(const string& name, const string& value, DatasetSpec& spec);
+
+string datasetExamCode(size_t exam);
+string datasetStudentId(size_t student);
+
+// Builds the teachers, exams and students in the given arena and vectors.
+void buildDataset(const DatasetSpec& spec, vector<Teacher*>& teachers, vector<Student*>& students, ObjectArena& arena);
+
+// data.txt and grades_db.csv in dir
+bool writeDataset(const DatasetSpec& spec, const string& dir);
+
+// A --grade-batch input: count submissions for one exam, one per student
+// (wrapping around), with answers in the format takeExam accepts.
+bool writeSubmissions(const DatasetSpec& spec, size_t exam, size_t count, const string& path);
+
+// A bulk import file (see importExams) with count exams in CSV, numbered after
+// the spec's own so their codes never clash with data.txt.
+bool writeExamImport(const DatasetSpec& spec, size_t count, const string& path);
+
+#endif
@@ -0,0 +1,618 @@
+#include "examSystem.h"
+
+// Regression tests for the examcore library. Every test runs in its own
+// empty folder, since the library reads and writes its files relative to the
+// working directory. Exits non-zero if any CHECK failed.
+
+int failures = 0;
+
+#define CHECK(cond)                                                                     \
+    do {                                                                                \
+        if (!(cond)) {                                                                  \
+            cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #cond ") failed\n";       \
+            failures++;                                                                 \
+        }                                                                               \
+    } while (0)
+
+// keeps the messages of expected failures out of the test output
+class QuietStream {
+    public:
+    ostream& stream;
+    streambuf* old;
+    QuietStream(ostream& stream) : stream(stream), old(stream.rdbuf(nullptr)) {}
+    ~QuietStream() { stream.rdbuf(old); }
+};
+
+ObjectArena testArena;
+
+Student* makeStudent(const string& id) {
+    vector<Teacher*> none;
+    return testArena.make<Student>("Test " + id, id, "pw", none, "riazi");
+}
+
+// a small exam with every question type, correct options spread over 0..3
+vector<Question*> makeExam(size_t n) {
+    vector<Question*> questions;
+    for (size_t i = 0; i < n; ++i) {
+        string text = "Soal " + to_string(i);
+        float pos = float(1 + i % 3), neg = float(i % 2) / 2;
+        if (i % 5 == 3) questions.push_back(testArena.make<ShortAnswerQuestion>(text, pos, neg, "javab" + to_string(i)));
+        else if (i % 5 == 4) questions.push_back(testArena.make<DescriptiveQuestion>(text, pos, "sharh"));
+        else questions.push_back(testArena.make<MultipleChoiceQuestion>(text, pos, neg, vector<string>{"a", "b", "c", "d"}, int(i % 4)));
+    }
+    return questions;
+}
+
+// what a student might type for question i, including the spellings stoi
+// accepted and answers that are not options at all
+string sampleAnswer(size_t student, size_t i) {
+    static const char* forms[] = {"1", "2", "3", "4", " 2", "+3", "4 ", "\t1", "0", "5", "x", "", "-1", "javab3", "javab8"};
+    return forms[(student * 31 + i * 7) % size(forms)];
+}
+
+void testParseChoice() {
+    CHECK(parseChoice("1") == 0 && parseChoice("4") == 3);
+    CHECK(parseChoice(" 2") == 1 && parseChoice("+2") == 1 && parseChoice("2 ") == 1 && parseChoice(" +3x") == 2);
+    CHECK(parseChoice("0") == -1 && parseChoice("5") == -1 && parseChoice("-1") == -1);
+    CHECK(parseChoice("") == -1 && parseChoice("x") == -1 && parseChoice("+") == -1 && parseChoice("+ 2") == -1);
+}
+
+// many threads taking the same exam at once must grade and render exactly
+// what the same attempts give one after another
+void testConcurrentSessions() {
+    vector<Question*> questions = makeExam(25);
+    const size_t nStudents = 4000, nThreads = 8;
+    auto attempt = [&](size_t s, float& total, string& sheet) {
+        ExamSession session("STRESS", "S" + to_string(s), questions);
+        for (size_t i = 0; i < questions.size(); ++i) session.record(i, sampleAnswer(s, i));
+        total = session.gradeAll();
+        sheet = session.sheet();
+    };
+
+    vector<float> expected(nStudents), totals(nStudents);
+    vector<string> expectedSheets(nStudents), sheets(nStudents);
+    for (size_t s = 0; s < nStudents; ++s) attempt(s, expected[s], expectedSheets[s]);
+
+    vector<thread> pool;
+    for (size_t t = 0; t < nThreads; ++t)
+    pool.emplace_back([&, t] {
+        for (size_t s = t; s < nStudents; s += nThreads) attempt(s, totals[s], sheets[s]);
+    });
+    for (auto& th : pool) th.join();
+
+    CHECK(totals == expected);
+    CHECK(sheets == expectedSheets);
+}
+
+// a batch merged in one go must leave the same results as adding one by one
+void testResultsAddAll() {
+    ExamResults one, all;
+    vector<pair<Symbol, float>> first, second;
+    for (uint32_t i = 0; i < 300; ++i) {
+        pair<Symbol, float> result(i % 250, float((i * 2654435761u) % 41) / 2 - 3);
+        one.add(result.first, result.second);
+        (i < 120 ? first : second).push_back(result);
+    }
+    all.addAll(first);
+    all.addAll({});
+    all.addAll(second);
+
+    CHECK(all.entries == one.entries);
+    vector<float> allScores, oneScores;
+    all.scores.forEach([&](float s) { allScores.push_back(s); });
+    one.scores.forEach([&](float s) { oneScores.push_back(s); });
+    CHECK(allScores == oneScores);
+    CHECK(all.sum == one.sum && all.maxScore == one.maxScore);
+    for (uint32_t s = 0; s < 250; ++s) CHECK(*all.scoreOf(s) == *one.scoreOf(s) && all.rankOf(*all.scoreOf(s)) == one.rankOf(*one.scoreOf(s)));
+}
+
+// the treap must agree with a sorted copy of the same scores, repeats and
+// negative marks included
+void testScoreIndex() {
+    ScoreIndex index;
+    vector<float> sorted;
+    for (uint32_t i = 0; i < 5000; ++i) {
+        float score = float(mix64(i) % 161) / 4 - 10;
+        index.insert(score);
+        sorted.insert(upper_bound(sorted.begin(), sorted.end(), score), score);
+    }
+    CHECK(index.size() == sorted.size() && index.nodes.size() == 161);
+    for (float score : {-10.5f, -10.0f, 0.0f, 0.1f, 17.25f, 30.0f, 31.0f})
+    CHECK(index.countAbove(score) == size_t(sorted.end() - upper_bound(sorted.begin(), sorted.end(), score)));
+    for (size_t k = 0; k < sorted.size(); k += 37) CHECK(index.kth(k) == sorted[k]);
+    CHECK(index.kth(sorted.size() - 1) == sorted.back());
+
+    vector<float> up, down;
+    index.forEach([&](float s) { up.push_back(s); });
+    index.forEach([&](float s) { down.push_back(s); }, true);
+    CHECK(up == sorted && vector<float>(down.rbegin(), down.rend()) == sorted);
+}
+
+// the flat key must give the same total as grading question by question on
+// an unshuffled session, including short answers whose key is empty, MCQs
+// whose stored correct index is -1 or out of range, and missing answers; an
+// answer that is no option never matches such an MCQ
+void testExamKeyScore() {
+    vector<Question*> questions = makeExam(20);
+    questions.push_back(testArena.make<ShortAnswerQuestion>("SA bi javab", 2.0f, 0.5f, ""));
+    questions.push_back(testArena.make<MultipleChoiceQuestion>("MCQ -1", 1.5f, 0.25f, vector<string>{"a", "b", "c", "d"}, -1));
+    questions.push_back(testArena.make<MultipleChoiceQuestion>("MCQ 7", 1.0f, 0.75f, vector<string>{"a", "b", "c", "d"}, 7));
+    ExamKey key(questions);
+
+    vector<uint8_t> hit;
+    vector<float> marks;
+    for (size_t s = 0; s < 500; ++s) {
+        // every fifth student stops answering part way through
+        size_t given = s % 5 == 0 ? s % questions.size() : questions.size();
+        vector<string> answers;
+        for (size_t i = 0; i < given; ++i) answers.push_back(sampleAnswer(s, i));
+
+        ExamSession session("KEY", "S" + to_string(s), questions, false);
+        for (size_t i = 0; i < questions.size(); ++i) session.record(i, i < given ? answers[i] : "");
+        CHECK(key.score(answers, hit, marks) == session.gradeAll());
+    }
+
+    vector<Question*> bad(questions.end() - 2, questions.end());
+    ExamKey badKey(bad);
+    for (string answer : {"", "x", "0", "9", "-1"}) {
+        CHECK(badKey.score({answer, answer}, hit, marks) == -0.25f - 0.75f);
+        CHECK(bad[0]->grade(answer, QuestionState()) == -0.25f);
+    }
+    CHECK(badKey.correctOption[0] == -2 && badKey.correctOption[1] == -2);
+}
+
+// the dispatched kernel (AVX2 where the CPU has it) must match the scalar
+// one bit for bit, for every tail length and both key layouts
+void testMcqMatrixKernel() {
+    uint64_t state = 12345;
+    auto next = [&] { return state = mix64(state + 0x9E3779B97F4A7C15ull); };
+    for (size_t nStudents : {size_t(1), size_t(7), size_t(8), size_t(9), size_t(17), size_t(64), size_t(301)})
+    for (size_t nQuestions : {size_t(1), size_t(3), size_t(31)})
+    for (bool perStudentKeys : {false, true}) {
+        vector<uint8_t> answers(nStudents * nQuestions), keys(perStudentKeys ? nStudents * nQuestions : nQuestions);
+        // 0xFF (no answer) and 0xFE (a key that never matches) included
+        for (auto& a : answers) a = next() % 6 == 0 ? 0xFF : uint8_t(next() % 4);
+        for (auto& k : keys) k = next() % 9 == 0 ? uint8_t(0xFE - next() % 2) : uint8_t(next() % 4);
+        vector<float> positive(nQuestions), negative(nQuestions);
+        for (size_t q = 0; q < nQuestions; ++q) {
+            positive[q] = float(next() % 1000) / 7;
+            negative[q] = float(next() % 300) / 11;
+        }
+
+        size_t stride = perStudentKeys ? nQuestions : 0;
+        vector<float> expected(nStudents), totals(nStudents, -1);
+        scoreMcqMatrixScalar(answers.data(), keys.data(), stride, nStudents, nQuestions, positive.data(), negative.data(), expected.data());
+        scoreMcqMatrix(answers.data(), keys.data(), stride, nStudents, nQuestions, positive.data(), negative.data(), totals.data());
+        CHECK(memcmp(totals.data(), expected.data(), nStudents * sizeof(float)) == 0);
+    }
+
+    // blank answers against the key gradeBatch builds for MCQs stored with
+    // -1 and with a valid index: every one costs the negative mark
+    vector<Question*> questions = {
+        testArena.make<MultipleChoiceQuestion>("MCQ -1", 2.0f, 1.0f, vector<string>{"a", "b", "c", "d"}, -1),
+        testArena.make<MultipleChoiceQuestion>("MCQ 2", 1.5f, 0.5f, vector<string>{"a", "b", "c", "d"}, 2)};
+    ExamKey key(questions);
+    vector<uint8_t> keys = {uint8_t(key.correctOption[0]), uint8_t(key.correctOption[1])};
+    CHECK(keys[0] != 0xFF && keys[1] == 2);
+    for (size_t nStudents : {size_t(1), size_t(9)}) {
+        vector<uint8_t> blank(nStudents * 2, 0xFF);
+        vector<float> totals(nStudents);
+        scoreMcqMatrix(blank.data(), keys.data(), 0, nStudents, 2, key.positive.data(), key.negative.data(), totals.data());
+        for (float total : totals) CHECK(total == -1.5f);
+    }
+}
+
+// report cards and the export print what the old loops computed: float sums
+// over the count, and a best score that never goes below 0
+void testExamStatsFigures() {
+    Symbol exam = symbols.intern("STATS");
+    vector<float> scores = {-1.1f, -3.3f, -2.7f, -0.3f};
+    ExamResults results;
+    for (size_t i = 0; i < scores.size(); ++i) results.append(symbols.intern("S" + to_string(i)), scores[i]);
+    results.buildRankIndex();
+    examResults.put(exam, move(results));
+
+    shared_ptr<const ExamStats> stats = statsCache.get(exam);
+    float inOrder = 0, bestFirst = 0;
+    for (float s : scores) inOrder += s;
+    for (float s : {-0.3f, -1.1f, -2.7f, -3.3f}) bestFirst += s;
+    CHECK(stats->bestScore == 0);
+    CHECK(stats->reportAverage == inOrder / scores.size());
+    CHECK(stats->exportAverage == bestFirst / scores.size());
+    CHECK(stats->scores.maxScore == -0.3f);
+
+    // a hit hands out the same entry; a new result builds a fresh one and
+    // leaves the old one intact for whoever still holds it
+    CHECK(statsCache.get(exam) == stats);
+    examResults.add(exam, symbols.intern("S9"), 4.5f);
+    shared_ptr<const ExamStats> fresh = statsCache.get(exam);
+    CHECK(fresh != stats && fresh->bestScore == 4.5f && fresh->scores.count == 5);
+    CHECK(stats->scores.count == 4);
+}
+
+// counts made on threads that have exited are kept, their shards are not
+void testMetricsRetiredThreads() {
+    uint64_t before = metrics.totals().counters[COUNTER_EXAMS_TAKEN];
+    metrics.count(COUNTER_EXAMS_TAKEN, 1);
+    size_t live = metrics.shards.size();
+    for (int round = 0; round < 4; ++round) {
+        vector<thread> pool;
+        for (int t = 0; t < 8; ++t) pool.emplace_back([] { metrics.count(COUNTER_EXAMS_TAKEN, 2); });
+        for (auto& th : pool) th.join();
+    }
+    CHECK(metrics.shards.size() == live);
+    CHECK(metrics.totals().counters[COUNTER_EXAMS_TAKEN] == before + 1 + 4 * 8 * 2);
+
+    for (uint64_t v : {0ull, 1ull, 2ull, 3ull, 255ull, 256ull, 1ull << 40, ~0ull}) {
+        size_t bits = 0;
+        while (bits < 64 && (v >> bits)) bits++;
+        CHECK(bitWidth(v) == bits);
+    }
+}
+
+// an export taken while results keep coming in lists exactly the results its
+// statistics were computed from
+void testExportMatchesStats() {
+    Symbol exam = symbols.intern("LIVE");
+    examResults.add(exam, symbols.intern("L0"), 1);
+    atomic<bool> done{false};
+    thread writer([&] {
+        for (uint32_t i = 1; i < 20000 && !done; ++i) examResults.add(exam, symbols.intern("L" + to_string(i)), float(i % 17));
+    });
+    for (int round = 0; round < 20; ++round) {
+        {
+            QuietStream quiet(cout);
+            exportExamGrades(exam);
+        }
+        ifstream in("grades_LIVE.txt");
+        string line;
+        size_t rows = 0, binned = 0;
+        bool histogram = false;
+        while (getline(in, line)) {
+            if (line.rfind("Name:", 0) == 0) rows++;
+            else if (line == "Histogram:") histogram = true;
+            else if (histogram) binned += stoul(line.substr(line.rfind(": ") + 2));
+        }
+        CHECK(rows > 0 && rows == binned);
+    }
+    done = true;
+    writer.join();
+}
+
+// several threads submitting at once: every job is graded, stored and logged
+// exactly once, and nothing was started before the first submission
+void testConcurrentSubmit() {
+    CHECK(!submissions.grader.joinable() && !gradeSink.flusher.joinable());
+    filesystem::create_directories("sheets");
+    filesystem::create_directories("desc_answ");
+    vector<Question*> questions = makeExam(10);
+    Symbol exam = symbols.intern("PIPE");
+    const size_t nThreads = 6, perThread = 300;
+    uint64_t before = submissions.completed;
+
+    vector<thread> pool;
+    for (size_t t = 0; t < nThreads; ++t)
+    pool.emplace_back([&, t] {
+        for (size_t s = t * perThread; s < (t + 1) * perThread; ++s) {
+            string id = "P" + to_string(s);
+            auto session = make_shared<ExamSession>("PIPE", id, questions);
+            for (size_t i = 0; i < questions.size(); ++i) session->record(i, sampleAnswer(s, i));
+            submissions.submit({exam, symbols.intern(id), session, {}});
+        }
+    });
+    for (auto& th : pool) th.join();
+    submissions.drain();
+    gradeSink.flush();
+
+    CHECK(submissions.completed - before == nThreads * perThread);
+    size_t stored = 0;
+    examResults.read(exam, [&](const ExamResults& results) { stored = results.entries.size(); });
+    CHECK(stored == nThreads * perThread);
+    for (size_t s = 0; s < nThreads * perThread; ++s) {
+        string id = "P" + to_string(s);
+        ExamSession expected("PIPE", id, questions);
+        for (size_t i = 0; i < questions.size(); ++i) expected.record(i, sampleAnswer(s, i));
+        shared_ptr<const ExamSession> attempt = attempts.find(exam, symbols.intern(id));
+        CHECK(attempt && attempt->total == expected.gradeAll());
+    }
+    ifstream log("grades_db.csv");
+    size_t lines = 0;
+    for (string line; getline(log, line);) lines++;
+    CHECK(lines == nThreads * perThread);
+}
+
+// the store keeps the newest capacity attempts; a retake counts as new, and
+// an attempt taken for its report card is gone
+void testAttemptStoreBound() {
+    AttemptStore store;
+    store.capacity = 10;
+    vector<Question*> questions = makeExam(2);
+    auto session = [&] { return make_shared<const ExamSession>("BOUND", "S", questions); };
+    for (Symbol s = 0; s < 25; ++s) store.put(1, s, session());
+    CHECK(store.size() == 10 && !store.find(1, 14) && store.find(1, 15) && store.find(1, 24));
+
+    store.put(1, 15, session());
+    store.put(1, 25, session());
+    CHECK(store.size() == 10 && store.find(1, 15) && !store.find(1, 16));
+
+    CHECK(store.take(1, 20) && !store.find(1, 20) && !store.take(1, 20) && store.size() == 9);
+    for (Symbol s = 100; s < 200; ++s) {
+        store.put(2, s, session());
+        store.take(2, s);
+    }
+    CHECK(store.size() == 9 && store.order.size() <= 2 * store.capacity);
+}
+
+// \u escapes: a surrogate pair decodes to one character, half of a pair or
+// a pair in the wrong order is a malformed row
+void testJsonSurrogates() {
+    auto text = [](const string& escaped, string& out) {
+        ImportRow row;
+        parseImportJson(R"({"code":"J","type":"DESC","text":")" + escaped + R"(","positive":1})", row);
+        out = row.text;
+        return row.error.empty();
+    };
+    string out;
+    CHECK(text(R"(a\u00e9\u0628)", out) && out == "a\xC3\xA9\xD8\xA8");
+    CHECK(text(R"(\ud83d\ude00!)", out) && out == "\xF0\x9F\x98\x80!");
+    CHECK(!text(R"(\ud83d)", out) && !text(R"(\ud83dx)", out) && !text(R"(\ud83d\u0041)", out));
+    CHECK(!text(R"(\ude00)", out) && !text(R"(\ude00\ud83d)", out) && !text(R"(\ud83d\ud83d)", out));
+}
+
+// a directory or a missing file is not a file that could be read
+void testReadWholeFile() {
+    string data = "old";
+    filesystem::create_directories("folder");
+    CHECK(!readWholeFile("folder", data) && !readWholeFile("missing", data));
+    ofstream("empty.bin").close();
+    CHECK(readWholeFile("empty.bin", data) && data.empty());
+    ofstream("data.bin", ios::binary) << string("a\0b", 3);
+    CHECK(readWholeFile("data.bin", data) && data == string("a\0b", 3));
+}
+
+// once an exam has results its blueprint stays as it is, from the menu and
+// from a journal replay, which says so
+void testBlueprintAfterResults() {
+    Teacher* teacher = testArena.make<Teacher>("Test T", "T1", "pw", vector<string>{"riazi"});
+    teacher->publishExam("BP", makeExam(20));
+    Symbol exam = symbols.intern("BP");
+    ExamBlueprint first, second;
+    first.count[0] = 5;
+    second.count[0] = 8;
+    CHECK(setBlueprint(exam, first).empty());
+
+    examResults.add(exam, symbols.intern("B0"), 3);
+    CHECK(!setBlueprint(exam, second).empty() && !setBlueprint(exam, ExamBlueprint()).empty());
+    CHECK(findBlueprint(exam) && findBlueprint(exam)->count[0] == 5);
+
+    {
+        Journal j("bp.journal");
+        CHECK(j.open());
+        BinaryWriter rec;
+        rec.str("BP");
+        writeBlueprint(rec, second);
+        j.append(JOURNAL_SET_BLUEPRINT, rec);
+        j.close();
+    }
+    vector<Teacher*> ts;
+    vector<Student*> ss;
+    ostringstream log;
+    streambuf* old = cerr.rdbuf(log.rdbuf());
+    size_t applied = replayJournal("bp.journal", ts, ss);
+    cerr.rdbuf(old);
+    CHECK(applied == 1 && log.str().find("BP") != string::npos);
+    CHECK(findBlueprint(exam)->count[0] == 5);
+}
+
+// a total the search can't settle within its budget is reported as such,
+// not as a total no mix of questions reaches
+void testBankSearchBudget() {
+    vector<Question*> pool;
+    for (int i = 1; i <= 60; ++i) pool.push_back(testArena.make<MultipleChoiceQuestion>("Soal", float(2 * i), 0, vector<string>{"a", "b", "c", "d"}, 0));
+    ExamBlueprint odd;
+    odd.count[0] = 20;
+    odd.totalMarks = 611;
+    QuestionBank exhausted(pool, odd);
+    CHECK(!exhausted.feasible && exhausted.budgetExhausted);
+
+    ExamBlueprint tooMuch = odd;
+    tooMuch.totalMarks = 5000;
+    QuestionBank ruledOut(pool, tooMuch);
+    CHECK(!ruledOut.feasible && !ruledOut.budgetExhausted);
+
+    ExamBlueprint even = odd;
+    even.totalMarks = 612;
+    QuestionBank found(pool, even);
+    CHECK(found.feasible && !found.budgetExhausted);
+}
+
+// students and questions keep every string and container in their arena, so
+// it never runs their destructors; teachers, with their std exam lists, still
+// get one
+void testArenaOwnsStrings() {
+    ObjectArena arena;
+    vector<Teacher*> none;
+    Student* s = arena.make<Student>(string(100, 'n'), "A1", "pw", none, "riazi");
+    s->reserveRegistrations(3);
+    for (Symbol exam = 0; exam < 3; ++exam) s->restoreRegistration(exam);
+    auto* q = arena.make<MultipleChoiceQuestion>(string(200, 't'), 1.0f, 0.0f, vector<string>{"a", "b", "c", string(50, 'd')}, 0);
+    CHECK(arena.objects == 2 && arena.destructors.empty());
+    CHECK(s->name.get_allocator().resource() == &arena && s->registeredSet.get_allocator().resource() == &arena);
+    CHECK(q->text.get_allocator().resource() == &arena && q->options[3].get_allocator().resource() == &arena);
+    CHECK(arena.bytesUsed >= sizeof(Student) + sizeof(MultipleChoiceQuestion) + 100 + 200 + 50);
+
+    arena.make<Teacher>("Test T", "T2", "pw", vector<string>{"riazi"});
+    CHECK(arena.objects == 3 && arena.destructors.size() == 1);
+
+    auto child = make_unique<ObjectArena>();
+    Student* adopted = child->make<Student>("Test C", "C1", "pw", none, "fizik");
+    arena.adopt(move(child));
+    adopted->restoreRegistration(7);
+    CHECK(arena.objectCount() == 4 && arena.destructorCount() == 1 && adopted->registeredExams.size() == 1);
+    arena.release();
+    CHECK(arena.objectCount() == 0 && arena.blockCount() == 0);
+}
+
+bool sameQuestions(const vector<Question*>& a, const vector<Question*>& b) {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); ++i) {
+        BinaryWriter x, y;
+        a[i]->saveBinary(x);
+        b[i]->saveBinary(y);
+        if (a[i]->getType() != b[i]->getType() || x.buf != y.buf) return false;
+    }
+    return true;
+}
+
+// a loaded snapshot decodes an exam's questions only when they are asked for,
+// and saving it again copies the undecoded ones without keeping them
+void testSnapshotLazyExams() {
+    vector<Teacher*> ts = {testArena.make<Teacher>("Ostad", "LAZY-T", "pw", vector<string>{"riazi"})};
+    vector<Question*> first = makeExam(7), second = makeExam(3);
+    ts[0]->exams.push_back({symbols.intern("LAZY-1"), first});
+    ts[0]->exams.push_back({symbols.intern("LAZY-2"), second});
+    vector<Student*> ss = {makeStudent("LAZY-S1"), makeStudent("LAZY-S2")};
+    for (Student* s : ss) s->restoreRegistration(symbols.intern("LAZY-2"));
+    CHECK(saveSnapshot("data.bin", ts, ss));
+
+    // both students' major and the registrations share pooled strings
+    string file;
+    CHECK(readWholeFile("data.bin", file));
+    CHECK(file.find("riazi") == file.rfind("riazi") && file.find("LAZY-2") == file.rfind("LAZY-2"));
+
+    ObjectArena arena;
+    vector<Teacher*> lt;
+    vector<Student*> ls;
+    CHECK(loadSnapshot("data.bin", lt, ls, arena));
+    CHECK(lt.size() == 1 && ls.size() == 2 && ls[1]->isRegistered(symbols.find("LAZY-2")));
+    Teacher* t = lt[0];
+    CHECK(t->exams.size() == 2 && t->snapshotExams == 2 && t->exams[0].second.empty());
+    CHECK(symbols.name(t->exams[1].first) == "LAZY-2");
+
+    ObjectArena scratch;
+    vector<Question*> decoded;
+    CHECK(sameQuestions(t->questionsToSave(1, scratch, decoded), second));
+    CHECK(t->exams[1].second.empty());
+
+    vector<Question*>& questions = t->questionsOf(0);
+    CHECK(sameQuestions(questions, first) && &t->questionsOf(0) == &questions);
+    CHECK(questions[0] == t->questionsOf(0)[0]);
+
+    // exam 2 is still in the mapped file while it is copied into the new one
+    CHECK(saveSnapshot("again.bin", lt, ls));
+    ObjectArena again;
+    vector<Teacher*> at;
+    vector<Student*> as;
+    CHECK(loadSnapshot("again.bin", at, as, again));
+    CHECK(at.size() == 1 && sameQuestions(at[0]->questionsOf(0), first) && sameQuestions(at[0]->questionsOf(1), second));
+
+    // tables that point past the end are refused up front
+    filesystem::resize_file("again.bin", filesystem::file_size("again.bin") - 1);
+    vector<Teacher*> bt;
+    vector<Student*> bs;
+    QuietStream quiet(cerr);
+    CHECK(!loadSnapshot("again.bin", bt, bs, again) && bt.empty());
+}
+
+// three signups, then the last record is cut short or damaged: replay must
+// apply the first two, cut the file back to them and append after them
+void testJournalTail() {
+    for (bool torn : {true, false}) {
+        string prefix = torn ? "torn" : "corrupt";
+        const string path = prefix + ".journal";
+        uintmax_t goodSize = 0, fullSize = 0;
+        {
+            Journal j(path);
+            CHECK(j.open());
+            for (int i = 0; i < 3; ++i) {
+                BinaryWriter rec;
+                writeStudent(rec, makeStudent(prefix + to_string(i)));
+                if (i == 2) {
+                    j.sync();
+                    goodSize = filesystem::file_size(path);
+                }
+                j.append(JOURNAL_SIGNUP_STUDENT, rec);
+            }
+            j.close();
+            fullSize = filesystem::file_size(path);
+        }
+        CHECK(fullSize > goodSize);
+
+        if (torn) {
+            filesystem::resize_file(path, fullSize - 3);
+        } else {
+            fstream f(path, ios::in | ios::out | ios::binary);
+            f.seekp(fullSize - 1);
+            f.put('\x7f');
+        }
+
+        vector<Teacher*> ts;
+        vector<Student*> ss;
+        {
+            QuietStream quiet(cerr);
+            CHECK(replayJournal(path, ts, ss) == 2);
+        }
+        CHECK(ss.size() == 2);
+        CHECK(filesystem::file_size(path) == goodSize);
+        CHECK(findUser(prefix + "0") && findUser(prefix + "1") && !findUser(prefix + "2"));
+
+        // a record appended after the cut is found on the next replay
+        {
+            Journal j(path);
+            CHECK(j.open());
+            BinaryWriter rec;
+            writeStudent(rec, makeStudent(prefix + "3"));
+            j.append(JOURNAL_SIGNUP_STUDENT, rec);
+            j.close();
+        }
+        ts.clear();
+        ss.clear();
+        size_t objects = dataArena.objectCount();
+        CHECK(replayJournal(path, ts, ss) == 3);
+        CHECK(ss.size() == 1 && ss[0]->id == string_view(prefix + "3"));
+        // the two duplicates were skipped, not decoded into dataArena
+        CHECK(dataArena.objectCount() == objects + 1);
+    }
+}
+
+struct TestCase {
+    const char* name;
+    void (*run)();
+};
+
+const TestCase TESTS[] = {
+    {"journal_tail", testJournalTail},
+    {"parse_choice", testParseChoice},
+    {"concurrent_sessions", testConcurrentSessions},
+    {"results_add_all", testResultsAddAll},
+    {"score_index", testScoreIndex},
+    {"exam_key_score", testExamKeyScore},
+    {"mcq_matrix_kernel", testMcqMatrixKernel},
+    {"exam_stats_figures", testExamStatsFigures},
+    {"metrics_retired_threads", testMetricsRetiredThreads},
+    {"export_matches_stats", testExportMatchesStats},
+    {"concurrent_submit", testConcurrentSubmit},
+    {"attempt_store_bound", testAttemptStoreBound},
+    {"json_surrogates", testJsonSurrogates},
+    {"read_whole_file", testReadWholeFile},
+    {"blueprint_after_results", testBlueprintAfterResults},
+    {"bank_search_budget", testBankSearchBudget},
+    {"arena_owns_strings", testArenaOwnsStrings},
+    {"snapshot_lazy_exams", testSnapshotLazyExams},
+};
+
+int main() {
+    filesystem::path origin = filesystem::current_path();
+    filesystem::path root = filesystem::temp_directory_path() / ("exam-tests-" + to_string(chrono::steady_clock::now().time_since_epoch().count()));
+    for (const TestCase& test : TESTS) {
+        int before = failures;
+        filesystem::create_directories(root / test.name);
+        filesystem::current_path(root / test.name);
+        test.run();
+        filesystem::current_path(origin);
+        cout << (failures == before ? "ok   " : "FAIL ") << test.name << "\n";
+    }
+    error_code ec;
+    filesystem::remove_all(root, ec);
+    return failures == 0 ? 0 : 1;
+}
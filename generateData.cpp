@@ -0,0 +1,59 @@
+#include "dataset.h"
+
+// Writes a deterministic synthetic data.txt and grades_db.csv, and optionally
+// a --grade-batch submissions file, for load and benchmark runs.
+int main(int argc, char* argv[]) {
+    DatasetSpec spec;
+    string dir = ".";
+    size_t batch = 0, batchExam = 0, importExams = 0;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        string name = argv[i], value = argv[i + 1];
+        if (name == "--scale") {
+            if (!datasetPreset(value, spec)) {
+                cerr << "Scale-e " << value << " shenakhte nashod (small, medium, large).\n";
+                return 1;
+            }
+        } else if (name == "--out") {
+            dir = value;
+        } else if (name == "--batch") {
+            batch = strtoull(value.c_str(), nullptr, 10);
+        } else if (name == "--batch-exam") {
+            batchExam = strtoull(value.c_str(), nullptr, 10);
+        } else if (name == "--import-exams") {
+            importExams = strtoull(value.c_str(), nullptr, 10);
+        } else if (!datasetOption(name, value, spec)) {
+            cerr << "Gozine-ye " << name << " shenakhte nashod.\n";
+            return 1;
+        }
+    }
+    if (argc % 2 == 0) {
+        cerr << "Gozine-ye " << argv[argc - 1] << " meghdar nadarad.\n";
+        return 1;
+    }
+
+    // the folders the application writes sheets and reports into
+    error_code ec;
+    for (const char* sub : {"", "/sheets", "/reports", "/desc_answ"}) filesystem::create_directories(dir + sub, ec);
+    auto start = chrono::steady_clock::now();
+    if (!writeDataset(spec, dir)) {
+        cerr << "Neveshtan dar " << dir << " anjam nashod.\n";
+        return 1;
+    }
+    if (batch > 0 && !writeSubmissions(spec, batchExam, batch, dir + "/submissions.tsv")) {
+        cerr << "Neveshtan-e submissions.tsv anjam nashod.\n";
+        return 1;
+    }
+    if (importExams > 0 && !writeExamImport(spec, importExams, dir + "/exams_import.csv")) {
+        cerr << "Neveshtan-e exams_import.csv anjam nashod.\n";
+        return 1;
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    cout << spec.teachers << " ostad, " << spec.exams() << " azmon x " << spec.questionsPerExam << " soal, "
+    << spec.students << " danesh-amooz, " << spec.results << " nomre";
+    if (batch > 0) cout << ", " << batch << " pasokh-name";
+    if (importExams > 0) cout << ", " << importExams << " azmon baraye import";
+    cout << " dar " << dir << " (" << seconds << " s).\n";
+    return 0;
+}
@@ -0,0 +1,170 @@
+#include "examSystem.h"
+#include <random>
+
+// Registers every student ID listed in the roster file (one per line) for
+// the given exam.
+void enrollRoster(const string& code, const string& filename) {
+    Symbol exam = symbols.find(code);
+    if (!lookupExam(exam)) {
+        cout << "Azmon " << code << " yaft nashod.\n";
+        return;
+    }
+
+    ifstream in(filename);
+    if (!in) {
+        cout << "File " << filename << " baz nashod.\n";
+        return;
+    }
+
+    vector<Student*> roster;
+    string id;
+    while (getline(in, id)) {
+        if (!id.empty() && id.back() == '\r') id.pop_back();
+        if (id.empty()) continue;
+        if (Student* s = dynamic_cast<Student*>(findUser(id))) roster.push_back(s);
+        else cerr << "Danesh-amooz " << id << " yaft nashod.\n";
+    }
+
+    size_t enrolled = registerMany(exam, roster);
+    cout << enrolled << " danesh-amooz dar azmon " << code << " sabt-nam shodand.\n";
+}
+
+// Imports the exams in the file (see importExams) as the given teacher's.
+void importForTeacher(const string& teacherId, const string& filename) {
+    Teacher* owner = dynamic_cast<Teacher*>(findUser(teacherId));
+    if (!owner) {
+        cout << "Ostad " << teacherId << " yaft nashod.\n";
+        return;
+    }
+    importExams(owner, filename);
+}
+
+// a whole unsigned number (decimal, 0x.. or 0..), nothing else
+bool parseSeed(const char* text, uint64_t& seed) {
+    char* end = nullptr;
+    errno = 0;
+    unsigned long long value = isdigit((unsigned char)text[0]) ? strtoull(text, &end, 0) : 0;
+    if (!end || *end != '\0' || errno != 0) return false;
+    seed = value;
+    return true;
+}
+
+const string SEED_FILE = "shuffle.seed";
+
+// The install's own shuffle seed, drawn from random_device on the first run
+// and kept in SEED_FILE from then on, so every sheet can still be regraded.
+// The file is read back after writing it, so two first runs racing each other
+// end up with the same seed.
+bool installSeed(uint64_t& seed) {
+    string text;
+    if (!readWholeFile(SEED_FILE, text)) {
+        random_device device;
+        uint64_t drawn = uint64_t(device()) << 32 | device();
+        char buf[32];
+        snprintf(buf, sizeof buf, "0x%016llx\n", (unsigned long long)drawn);
+        string tmp = SEED_FILE + ".tmp";
+        FILE* out = fopen(tmp.c_str(), "wb");
+        if (!out) return false;
+        bool ok = fputs(buf, out) >= 0;
+        ok = syncFile(out) && ok;
+        ok = fclose(out) == 0 && ok;
+        error_code ec;
+        if (ok) filesystem::rename(tmp, SEED_FILE, ec);
+        if (!ok || ec || !syncDirectory(SEED_FILE) || !readWholeFile(SEED_FILE, text)) return false;
+    }
+    while (!text.empty() && isspace((unsigned char)text.back())) text.pop_back();
+    return parseSeed(text.c_str(), seed);
+}
+
+// With EXAM_METRICS_FILE=<base> set, <base>.prom and <base>.json are written
+// when the program exits.
+class MetricsDump {
+    public:
+    ~MetricsDump() {
+        const char* base = getenv("EXAM_METRICS_FILE");
+        if (!base || !*base) return;
+        ofstream prom(string(base) + ".prom");
+        writeMetricsPrometheus(prom);
+        ofstream json(string(base) + ".json");
+        writeMetricsJson(json);
+        if (!prom || !json) cerr << "Couldn't write metrics to " << base << ".\n";
+    }
+};
+
+int main(int argc, char* argv[]) {
+    MetricsDump metricsDump;
+    // the library's built-in seed is public and only meant for tests and
+    // benchmarks; the program always runs with its own
+    if (const char* seed = getenv("EXAM_SHUFFLE_SEED")) {
+        if (!parseSeed(seed, shuffleSeed)) {
+            cerr << "EXAM_SHUFFLE_SEED namotabar ast: \"" << seed << "\"\n";
+            return 1;
+        }
+    } else if (!installSeed(shuffleSeed)) {
+        cerr << "Seed-e " << SEED_FILE << " khande ya sakhte nashod; EXAM_SHUFFLE_SEED ra tanzim konid.\n";
+        return 1;
+    }
+
+    if (argc > 1 && string(argv[1]) == "--export-text") {
+        // replaying a blueprint checks the exam's results, as on a normal start
+        auto results = async(launch::async, readExamResults, "grades_db.csv");
+        loadData(teachers, students, [&] { examResults.assign(results.get()); });
+        saveTextData(LEGACY_DATA_FILE, teachers, students);
+        cout << "Dadeha dar " << LEGACY_DATA_FILE << " zakhire shod.\n";
+        return 0;
+    }
+
+    if (argc > 1 && string(argv[1]) == "--import-text") {
+        if (!importTextData(teachers, students)) {
+            cerr << "Dadeha az " << LEGACY_DATA_FILE << " dar " << SNAPSHOT_FILE << " zakhire nashod.\n";
+            return 1;
+        }
+        cout << "Dadeha-ye " << LEGACY_DATA_FILE << " dar " << SNAPSHOT_FILE << " zakhire shod.\n";
+        return 0;
+    }
+
+    auto results = async(launch::async, readExamResults, "grades_db.csv");
+    loadData(teachers, students, [&] { examResults.assign(results.get()); });
+    if (!journal.open())
+    cerr << "Journal " << JOURNAL_FILE << " baz nashod; taghirat faghat dar khoroj zakhire mishavand.\n";
+
+    if (argc > 2 && string(argv[1]) == "--grade-batch") {
+        gradeBatch(argv[2]);
+        return 0;
+    }
+
+    if (argc > 3 && string(argv[1]) == "--enroll") {
+        enrollRoster(argv[2], argv[3]);
+        return 0;
+    }
+
+    if (argc > 3 && string(argv[1]) == "--import-exams") {
+        importForTeacher(argv[2], argv[3]);
+        return 0;
+    }
+
+    int choice;
+    do {
+        cout << "\n1. Signup\n2. Login\n3. Exit\nChoice: ";
+        cin >> choice;
+        cin.ignore();
+
+        switch (choice) {
+            case 1:
+            signup();
+            break;
+            case 2:
+            login();
+            break;
+            case 3:
+            submissions.drain();
+            saveData(teachers, students);
+            gradeSink.flush();
+            break;
+            default:
+            cout << "Invalid choice.\n";
+        }
+    } while (choice != 3);
+
+    return 0;
+}
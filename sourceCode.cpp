@@ -1,658 +1,470 @@
-#include <iostream>
-#include <vector>
-#include <string>
-#include <cstdlib>
-#include <ctime>
-#include <fstream>
-#include <map>
-#include <algorithm>
-#include <random>
-#include <sstream>
-using namespace std;
-
-map<string, vector<pair<string, float>>> examResults;
-void exportExamGrades(const string& code);
-
-
-
-class Question {
-    public:
-    string text;
-    float positiveMark;
-    float negativeMark;
-
-    Question(string t, float pos, float neg)
-    : text(t), positiveMark(pos), negativeMark(neg) {}
-
-    virtual void ask() = 0;
-    virtual float grade(string answer) = 0;
-    virtual string getType() = 0;
-    virtual void save(ofstream& out) = 0;
-    virtual void load(ifstream& in) = 0;
-    virtual ~Question() {}
-};
-
-class MultipleChoiceQuestion : public Question {
-    public:
-    vector<string> options;
-    int correctOptionIndex;
-    vector<int> shuffledIndices;
-
-    MultipleChoiceQuestion(string t, float pos, float neg, vector<string> opts, int correctIdx)
-    : Question(t, pos, neg), options(opts), correctOptionIndex(correctIdx) {}
-
-    MultipleChoiceQuestion() : Question("", 0, 0), correctOptionIndex(0) {}
-
-    void ask() override {
-        cout << text << "\n";
-
-
-        vector<int> indices = {0, 1, 2, 3};
-
-        mt19937 rng{random_device{}()};
-        shuffle(indices.begin(), indices.end(), rng);
-
-
-        shuffledIndices = indices;
-
-        for (int i = 0; i < 4; i++) {
-            cout << i + 1 << ". " << options[indices[i]] << "\n";
-        }
-    }
-
-    float grade(string answer) override {
-        int userChoice = stoi(answer) - 1;
-
-        if (userChoice < 0 || userChoice >= 4) return -negativeMark;
-
-
-        int originalIndex = shuffledIndices[userChoice];
-
-        if (originalIndex == correctOptionIndex)
-        return positiveMark;
-        else
-        return -negativeMark;
+#include "examSystem.h"
+
+SymbolTable symbols;
+uint64_t shuffleSeed = 0x45584D5348554646ull;
+atomic<uint64_t> resultsVersionCounter{0};
+ResultStore examResults;
+
+ScoreStats computeScoreStats(const ExamResults& results, size_t bins) {
+    ScoreStats stats;
+    const ScoreIndex& sorted = results.scores;
+    stats.count = sorted.size();
+    if (stats.count == 0) return stats;
+
+    stats.minScore = sorted.kth(0);
+    stats.maxScore = sorted.kth(stats.count - 1);
+    size_t mid = stats.count / 2;
+    stats.median = stats.count % 2 ? sorted.kth(mid) : (sorted.kth(mid - 1) + sorted.kth(mid)) / 2;
+    for (int p : {10, 25, 75, 90, 99}) {
+        // nearest rank
+        size_t rank = max<size_t>(1, size_t(ceil(p / 100.0 * stats.count)));
+        stats.percentiles.push_back({p, sorted.kth(rank - 1)});
     }
 
-    string getType() override { return "MCQ"; }
-
-    void save(ofstream& out) override {
-        out << getType() << "\n" << text << "\n" << positiveMark << "\n" << negativeMark << "\n";
-        for (int i = 0; i < 4; i++) out << options[i] << "\n";
-        out << correctOptionIndex << "\n";
-    }
-
-    void load(ifstream& in) override {
-        getline(in, text);
-        in >> positiveMark >> negativeMark;
-        in.ignore();
-        options.resize(4);
-        for (int i = 0; i < 4; i++) getline(in, options[i]);
-        in >> correctOptionIndex;
-        in.ignore();
-    }
-};
-
-
-class ShortAnswerQuestion : public Question {
-    public:
-    string correctAnswer;
-
-    ShortAnswerQuestion(string t, float pos, float neg, string corrAns)
-    : Question(t, pos, neg), correctAnswer(corrAns) {}
+    // mean and variance (Welford) and the histogram in a single pass
+    stats.histogram.assign(bins, 0);
+    double width = double(stats.maxScore - stats.minScore) / bins;
+    double m2 = 0;
+    size_t n = 0;
+    sorted.forEach([&](float x) {
+        double delta = x - stats.mean;
+        stats.mean += delta / ++n;
+        m2 += delta * (x - stats.mean);
+        size_t bin = width > 0 ? size_t((x - stats.minScore) / width) : 0;
+        stats.histogram[min(bin, bins - 1)]++;
+    });
+    stats.stddev = sqrt(m2 / n);
+    return stats;
+}
 
-    ShortAnswerQuestion() : Question("", 0, 0), correctAnswer("") {}
+unordered_map<Symbol, ExamEntry> examIndex;
 
-    void ask() override {
-        cout << text << "\n";
-    }
+size_t parallelThreads = 0;
 
-    float grade(string answer) override {
-        return (answer == correctAnswer) ? positiveMark : -negativeMark;
+void parallelFor(size_t n, size_t minPerThread, const function<void(size_t, size_t)>& fn) {
+    size_t threads = max<size_t>(1, parallelThreads ? parallelThreads : thread::hardware_concurrency());
+    threads = min(threads, max<size_t>(1, n / max<size_t>(1, minPerThread)));
+    if (threads <= 1) {
+        fn(0, n);
+        return;
     }
 
-    string getType() override { return "SA"; }
+    vector<thread> pool;
+    size_t chunk = (n + threads - 1) / threads;
+    for (size_t b = 0; b < n; b += chunk) pool.emplace_back(fn, b, min(n, b + chunk));
+    for (auto& t : pool) t.join();
+}
 
-    void save(ofstream& out) override {
-        out << getType() << "\n" << text << "\n" << positiveMark << "\n" << negativeMark << "\n" << correctAnswer << "\n";
-    }
+MetricRegistry metrics;
+
+int parseChoice(const string& answer) {
+    // the prefix stoi used to accept: leading blanks and a '+' before the digits
+    const char* p = answer.data();
+    const char* end = p + answer.size();
+    while (p < end && isspace(uint8_t(*p))) p++;
+    if (p < end && *p == '+') p++;
+    int userChoice = 0;
+    auto res = from_chars(p, end, userChoice);
+    if (res.ec != errc() || userChoice < 1 || userChoice > 4) return -1;
+    return userChoice - 1;
+}
 
-    void load(ifstream& in) override {
-        getline(in, text);
-        in >> positiveMark >> negativeMark;
-        in.ignore();
-        getline(in, correctAnswer);
+void scoreMcqMatrixScalar(const uint8_t* answers, const uint8_t* keys, size_t keyStride,
+size_t nStudents, size_t nQuestions, const float* positive, const float* negative, float* totals) {
+    for (size_t s = 0; s < nStudents; ++s) {
+        const uint8_t* row = answers + s * nQuestions;
+        const uint8_t* key = keys + s * keyStride;
+        float total = 0;
+        for (size_t q = 0; q < nQuestions; ++q) total += row[q] == key[q] ? positive[q] : -negative[q];
+        totals[s] = total;
     }
-};
-
-class DescriptiveQuestion : public Question {
-    public:
-    string correctAnswer;
-    string studentAnswer;
-
-    DescriptiveQuestion(string t, float pos, string corrAns)
-    : Question(t, pos, 0), correctAnswer(corrAns) {}
-
-    DescriptiveQuestion() : Question("", 0, 0), correctAnswer("") {}
+}
 
-    void ask() override {
-        cout << text << "\n";
+#ifdef EXAM_HAVE_AVX2_KERNEL
+__attribute__((target("avx2")))
+void scoreMcqMatrixAvx2(const uint8_t* answers, const uint8_t* keys, size_t keyStride,
+size_t nStudents, size_t nQuestions, const float* positive, const float* negative, float* totals) {
+    size_t s = 0;
+    const __m256 signBit = _mm256_set1_ps(-0.0f);
+    for (; s + 8 <= nStudents; s += 8) {
+        const uint8_t* a = answers + s * nQuestions;
+        const uint8_t* k = keys + s * keyStride;
+        __m256 acc = _mm256_setzero_ps();
+        for (size_t q = 0; q < nQuestions; ++q) {
+            size_t n = nQuestions, ks = keyStride;
+            __m256i chosen = _mm256_setr_epi32(a[q], a[n + q], a[2 * n + q], a[3 * n + q],
+            a[4 * n + q], a[5 * n + q], a[6 * n + q], a[7 * n + q]);
+            __m256i key = _mm256_setr_epi32(k[q], k[ks + q], k[2 * ks + q], k[3 * ks + q],
+            k[4 * ks + q], k[5 * ks + q], k[6 * ks + q], k[7 * ks + q]);
+            __m256 hit = _mm256_castsi256_ps(_mm256_cmpeq_epi32(chosen, key));
+            __m256 pos = _mm256_set1_ps(positive[q]);
+            __m256 neg = _mm256_xor_ps(_mm256_set1_ps(negative[q]), signBit);
+            acc = _mm256_add_ps(acc, _mm256_blendv_ps(neg, pos, hit));
+        }
+        _mm256_storeu_ps(totals + s, acc);
     }
-
-    float grade(string answer) override {
-        studentAnswer = answer;
-        return 0;
+    scoreMcqMatrixScalar(answers + s * nQuestions, keys + s * keyStride, keyStride,
+    nStudents - s, nQuestions, positive, negative, totals + s);
+}
+#endif
+
+void scoreMcqMatrix(const uint8_t* answers, const uint8_t* keys, size_t keyStride,
+size_t nStudents, size_t nQuestions, const float* positive, const float* negative, float* totals) {
+#ifdef EXAM_HAVE_AVX2_KERNEL
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    if (avx2) {
+        scoreMcqMatrixAvx2(answers, keys, keyStride, nStudents, nQuestions, positive, negative, totals);
+        return;
     }
+#endif
+    scoreMcqMatrixScalar(answers, keys, keyStride, nStudents, nQuestions, positive, negative, totals);
+}
 
-    string getStudentAnswer() const {
-        return studentAnswer;
-    }
+ExamStatsCache statsCache;
+QuestionBankCache questionBanks;
+ObjectArena dataArena;
 
-    string getType() override { return "DESC"; }
+Question* makeQuestion(string_view type, ObjectArena& arena) {
+    if (type == "MCQ") return arena.make<MultipleChoiceQuestion>();
+    if (type == "SA") return arena.make<ShortAnswerQuestion>();
+    if (type == "DESC") return arena.make<DescriptiveQuestion>();
+    return nullptr;
+}
 
-    void save(ofstream& out) override {
-        out << getType() << "\n" << text << "\n" << positiveMark << "\n" << correctAnswer << "\n";
+void writeExam(BinaryWriter& w, const string& code, const vector<Question*>& questions) {
+    w.str(code);
+    w.u32(questions.size());
+    for (auto* q : questions) {
+        w.str(q->getType());
+        q->saveBinary(w);
     }
+}
 
-    void load(ifstream& in) override {
-        getline(in, text);
-        in >> positiveMark;
-        in.ignore();
-        getline(in, correctAnswer);
+bool readExam(BinaryReader& r, string& code, vector<Question*>& questions, ObjectArena& arena) {
+    code = r.str();
+    uint32_t numQuestions = r.u32();
+    for (uint32_t k = 0; k < numQuestions && r.ok; ++k) {
+        Question* q = makeQuestion(r.view(), arena);
+        if (!q) {
+            r.ok = false;
+            break;
+        }
+        q->loadBinary(r);
+        questions.push_back(q);
     }
-};
-
-class User {
-    public:
-    string name;
-    string id;
-    string password;
-
-    User(string name, string id, string password)
-    : name(name), id(id), password(password) {}
-
-    virtual void displayMenu() = 0;
-};
-
-class Teacher : public User {
-    public:
-    vector<pair<string, vector<Question*>>> exams;
+    return r.ok;
+}
 
-    vector<string> courses;
+void writeBlueprint(BinaryWriter& w, const ExamBlueprint& blueprint) {
+    for (uint32_t count : blueprint.count) w.u32(count);
+    w.f32(blueprint.totalMarks);
+}
 
-    Teacher(string name, string id, string password, vector<string> courses)
-    : User(name, id, password), courses(courses) {}
+ExamBlueprint readBlueprint(BinaryReader& r) {
+    ExamBlueprint blueprint;
+    for (uint32_t& count : blueprint.count) count = r.u32();
+    blueprint.totalMarks = r.f32();
+    return blueprint;
+}
 
-    void displayMenu() override {
-        int choice;
-        do {
-            cout << "\nmenu-ye ostad:\n";
-            cout << "1. ejad azmon\n";
-            cout << "2. moshahede-ye azmonha\n";
-            cout << "3. daryaft liste nomarat\n";
-            cout << "4. khoroj az hesab\n";
-            cout << "entekhab konid: ";
-            cin >> choice;
-
-            switch (choice) {
-                case 1:
-                createExam();
-                break;
-                case 2:
-                viewExams();
-                break;
-                case 3: {
-                    string code;
-                    cout << "Code azmon baraye daryaft liste nomarat: ";
-                    cin >> code;
-                    exportExamGrades(code);
-                    break;
-                }
-            }
-        } while (choice != 4);
+uint32_t checksum(const char* data, size_t n) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < n; ++i) {
+        h ^= uint8_t(data[i]);
+        h *= 16777619u;
     }
+    return h;
+}
 
+Journal journal(JOURNAL_FILE);
 
-    void createExam() {
-        string code;
-        cout << "Code yektaye azmon ra vared konid: ";
-        cin >> code;
-        cin.ignore();
-
-        vector<Question*> questions;
-        int choice;
-        do {
-            cout << "\n1. Soal jadid\n2. Etemam sakhte azmon\nEntekhab: ";
-            cin >> choice;
-            cin.ignore();
-
-            if (choice == 1) {
-                int type;
-                cout << "Noe soal (1. MCQ - 2. ShortAnswer - 3. Descriptive): ";
-                cin >> type;
-                cin.ignore();
-
-                string text;
-                float pos, neg = 0;
-
-                cout << "Soal: ";
-                getline(cin, text);
-
-                cout << "Nomre mosbat: ";
-                cin >> pos;
-                cin.ignore();
-
-                if (type != 3) {
-                    cout << "Nomre manfi: ";
-                    cin >> neg;
-                    cin.ignore();
-                }
-
-                if (type == 1) {
-                    vector<string> opts(4);
-                    for (int i = 0; i < 4; ++i) {
-                        cout << "Gozine " << i + 1 << ": ";
-                        getline(cin, opts[i]);
-                    }
-                    int correct;
-                    cout << "Shomare gozine dorost (1-4): ";
-                    cin >> correct;
-                    cin.ignore();
+string sheetPath(string_view studentId, string_view code) {
+    string path = "./sheets/sheet";
+    path.append(studentId).append("_").append(code).append(".txt");
+    return path;
+}
 
-                    questions.push_back(new MultipleChoiceQuestion(text, pos, neg, opts, correct - 1));
+GradeSink gradeSink;
+AttemptStore attempts;
+// after gradeSink, so it is closed (and drained) before the sink
+SubmissionPipeline submissions;
+
+void logExamResult(const string& studentId, const string& examCode, float finalGrade) {
+    METRIC_TIMER(TIMER_LOG_EXAM_RESULT);
+    METRIC_COUNT(COUNTER_RESULTS_LOGGED, 1);
+    ostringstream line;
+    line << examCode << "," <<studentId<< "," << finalGrade << "\n";
+    gradeSink.append("grades_db.csv", line.str());
+}
 
-                } else if (type == 2) {
-                    string ans;
-                    while (true) {
-                        cout << "Javab dorost (yek kalame ya adad): ";
-                        getline(cin, ans);
+unordered_map<string_view, User*> userDirectory;
 
+User* findUser(string_view id) {
+    auto it = userDirectory.find(id);
+    return it == userDirectory.end() ? nullptr : it->second;
+}
 
-                        if (ans.find(' ') != string::npos) {
-                            cout << "Javab faghat bayad yek kalame ya adad bashad. Lotfan dobare vared konid.\n";
-                        } else {
-                            break;
-                        }
-                    }
+bool addUser(User* user) {
+    // on duplicate IDs the first user wins, teachers before students as login used to check them
+    return userDirectory.emplace(user->id, user).second;
+}
 
-                    questions.push_back(new ShortAnswerQuestion(text, pos, neg, ans));
+const ExamEntry* lookupExam(Symbol code) {
+    auto it = examIndex.find(code);
+    return it == examIndex.end() ? nullptr : &it->second;
+}
 
+const ExamEntry* lookupExam(string_view code) {
+    return lookupExam(symbols.find(code));
+}
 
-                } else if (type == 3) {
-                    string correctAns;
-                    cout << "Javab pishnahadi (baraye rahnama ya tas'hih): ";
-                    getline(cin, correctAns);
-                    questions.push_back(new DescriptiveQuestion(text, pos, correctAns));
-                }
+vector<Question*>* findExam(Symbol code) {
+    const ExamEntry* entry = lookupExam(code);
+    return entry ? &entry->owner->questionsOf(entry->index) : nullptr;
+}
 
+vector<Question*>* findExam(string_view code) {
+    return findExam(symbols.find(code));
+}
 
-            }
-        } while (choice != 2);
+const ExamBlueprint* findBlueprint(Symbol exam) {
+    const ExamEntry* entry = lookupExam(exam);
+    if (!entry) return nullptr;
+    auto it = entry->owner->blueprints.find(exam);
+    return it == entry->owner->blueprints.end() ? nullptr : &it->second;
+}
 
-        exams.push_back({code, questions});
-        cout << "Azmon sakhte shod.\n";
-    }
+vector<Question*> examQuestionsFor(Symbol exam, string_view studentId) {
+    if (shared_ptr<const QuestionBank> bank = questionBanks.get(exam))
+    // its own stream, so the draw and the option orders stay independent
+    return bank->assemble(mix64(shuffleStream(symbols.name(exam), studentId) ^ 0x42414E4B41535342ull));
+    vector<Question*>* questions = findExam(exam);
+    return questions ? *questions : vector<Question*>();
+}
 
+string setBlueprint(Symbol exam, const ExamBlueprint& blueprint) {
+    const ExamEntry* entry = lookupExam(exam);
+    if (!entry) return "Azmon yaft nashod.";
+    Teacher* owner = entry->owner;
 
-    void viewExams() {
-        if (exams.empty()) {
-            cout << "hich azmoni vojod nadarad.\n";
-            return;
-        }
+    bool hasResults = false;
+    examResults.read(exam, [&](const ExamResults& results) { hasResults = !results.entries.empty(); });
+    if (hasResults) return "In azmon natije darad; tarkib-e soalat-ash digar avaz nemishavad.";
 
-        cout << "azmonha:\n";
-        for (const auto& exam : exams) {
-            cout << "- code: " << exam.first << "\n";
+    if (blueprint.questions() == 0) {
+        owner->blueprints.erase(exam);
+    } else {
+        QuestionBank bank(owner->questionsOf(entry->index), blueprint);
+        const char* names[3] = {"MCQ", "SA", "DESC"};
+        for (size_t t = 0; t < 3; ++t)
+        if (blueprint.count[t] > bank.types[t].questions.size())
+        return "Faghat " + to_string(bank.types[t].questions.size()) + " soal-e " + names[t] + " dar azmon hast.";
+        if (bank.budgetExhausted) {
+            ostringstream out;
+            out << "Jostojoo baraye majmoo-e nomre-ye " << blueprint.totalMarks << " be natije naresid; tedad ya majmoo-e nomre ra avaz konid.";
+            return out.str();
         }
-
-        string selectedExamCode;
-        cout << "\ncode-ye azmon ra vared konid (ya '0' baraye bazgasht): ";
-        cin >> selectedExamCode;
-
-        if (selectedExamCode == "0") return;
-
-        for (const auto& exam : exams) {
-            if (exam.first == selectedExamCode) {
-                cout << "\nsoalat azmon " << selectedExamCode << ":\n";
-                for (Question* q : exam.second) {
-                    q->ask();
-                    cout << "----------------\n";
-                }
-                int subChoice;
-                cout << "\n1. bazgasht\n2. export nomarat be file\nentekhab: ";
-                cin >> subChoice;
-                if (subChoice == 2) {
-                    exportExamGrades(selectedExamCode);
-                }
-
-                return;
-            }
+        if (!bank.feasible) {
+            ostringstream out;
+            out << "Hich tarkibi az soalat majmoo-e nomre-ye " << blueprint.totalMarks << " nemidahad.";
+            return out.str();
         }
-
-        cout << "azmon yaft nashod.\n";
+        owner->blueprints[exam] = blueprint;
     }
+    questionBanks.invalidate(exam);
+    statsCache.invalidate(exam);
+    return "";
+}
 
+string publishBlueprint(Symbol exam, const ExamBlueprint& blueprint) {
+    string error = setBlueprint(exam, blueprint);
+    if (!error.empty()) return error;
+    BinaryWriter rec;
+    rec.str(symbols.name(exam));
+    writeBlueprint(rec, blueprint);
+    journal.append(JOURNAL_SET_BLUEPRINT, rec);
+    if (!compactJournal(teachers, students))
+    cerr << "Snapshot zakhire nashod; tarkib-e azmon " << symbols.name(exam) << " faghat dar journal ast.\n";
+    return "";
+}
 
-};
-
-class Student : public User {
-    public:
-    vector<string> registeredExams;
-    vector<Teacher*>& teachers;
-    string major;
+bool registerExam(Teacher* owner, size_t index) {
+    // on duplicate codes the first exam wins, as the old linear search did
+    return examIndex.emplace(owner->exams[index].first, ExamEntry{owner, index}).second;
+}
 
-    Student(string name, string id, string password, vector<Teacher*>& teachers, string major)
-    : User(name, id, password), teachers(teachers), major(major) {}
+void rebuildExamIndex(const vector<Teacher*>& teachers) {
+    size_t total = 0;
+    for (Teacher* t : teachers) total += t->exams.size();
 
-    void displayMenu() override {
-        int choice;
-        do {
-            cout << "\nmenu-ye danesh-amooz:\n";
-            cout << "1. sabt-nam dar azmon\n";
-            cout << "2. moshahede azmon-ha\n";
-            cout << "3. sherkat dar azmon\n";
-            cout << "4. moshahede-ye karname\n";
-            cout << "5. khoroj az hesab\n";
-
-            cout << "entekhab konid: ";
-            cin >> choice;
-
-            switch (choice) {
-                case 1:
-                addExam();
-                break;
-                case 2:
-                viewRegisteredExams();
-                break;
-                case 3:
-                takeExam();
-                break;
-                case 4:
-                string code;
-                cout << "Code azmon baraye karname: ";
-                cin >> code;
-                generateReportCard(code);
-                break;
+    examIndex.clear();
+    examIndex.reserve(total);
+    for (Teacher* t : teachers)
+    for (size_t i = 0; i < t->exams.size(); ++i)
+    registerExam(t, i);
+}
 
+size_t generateAllReportCards(Symbol exam) {
+    if (!findExam(exam)) return 0;
+    const string& code = symbols.name(exam);
+    // sheets of attempts no longer in the store must be on disk
+    submissions.drain();
+    gradeSink.flush();
+
+    // participants, scores and ranks are copied under the shard lock, from
+    // the results the stats were built on (a result that lands in between
+    // means another round); the files are written after releasing it
+    struct Participant {
+        Student* student;
+        float score;
+        int rank;
+    };
+    vector<Participant> participants;
+    shared_ptr<const ExamStats> stats;
+    bool current = false;
+    while (!current) {
+        stats = statsCache.get(exam);
+        participants.clear();
+        bool any = examResults.read(exam, [&](const ExamResults& results) {
+            current = results.version == stats->resultsVersion;
+            if (!current) return;
+            participants.reserve(results.byStudent.size());
+            for (auto& entry : results.byStudent)
+            if (Student* s = dynamic_cast<Student*>(findUser(symbols.name(entry.first)))) {
+                float score = results.entries[entry.second].second;
+                participants.push_back({s, score, results.rankOf(score)});
             }
-        } while (choice != 5);
+        });
+        if (!any) break;
     }
 
-    void addExam() {
-        string examCode;
-        cout << "code-ye azmon ra vared konid: ";
-        cin >> examCode;
-
-        for (const auto& exam : registeredExams)
-        if (exam == examCode) {
-            cout << "shoma ghablan sabt nam karde-id.\n";
-            return;
+    vector<char> written(participants.size(), 0);
+    parallelFor(participants.size(), 64, [&](size_t begin, size_t end) {
+        string report;
+        for (size_t i = begin; i < end; ++i) {
+            METRIC_TIMER(TIMER_REPORT_CARD);
+            const Participant& p = participants[i];
+            // a report without its answer sheet is still written, but not counted
+            bool complete = p.student->buildReportCard(code, *stats, p.score, p.rank, report);
+            written[i] = p.student->writeReportCard(code, report) && complete;
         }
+    });
+    size_t total = count(written.begin(), written.end(), 1);
+    METRIC_COUNT(COUNTER_REPORT_CARDS, total);
+    return total;
+}
 
-        for (Teacher* teacher : teachers)
-        for (const auto& exam : teacher->exams)
-        if (exam.first == examCode) {
-            registeredExams.push_back(examCode);
-            cout << "sabt-nam ba movafaghiyat anjam shod.\n";
-            return;
-        }
+size_t registerMany(Symbol exam, const vector<Student*>& roster) {
+    if (!lookupExam(exam)) return 0;
 
-        cout << "azmon yaft nashod.\n";
+    const string& code = symbols.name(exam);
+    vector<BinaryWriter> records;
+    for (Student* s : roster) {
+        if (!s->restoreRegistration(exam)) continue;
+        records.emplace_back();
+        records.back().str(s->id);
+        records.back().str(code);
     }
+    journal.appendAll(JOURNAL_REGISTER, records);
+    return records.size();
+}
 
-    void viewRegisteredExams() {
-        if (registeredExams.empty()) {
-            cout << "hich azmoni sabt nashode ast.\n";
-            return;
-        }
-        cout << "azmonha:\n";
-        for (const auto& exam : registeredExams)
-        cout << "- " << exam << "\n";
-    }
-
-    void takeExam() {
-        string code;
-        cout << "Code azmon: ";
-        cin >> code;
-        cin.ignore();
-
-        bool found = false;
-
-        ofstream out_sheet("./sheets/sheet" + id + "_" + code + ".txt");
-
-        for (Teacher* t : teachers) {
-            for (auto& ex : t->exams) {
-                if (ex.first == code) {
-                    found = true;
-
-                    float total = 0;
-                    int questionCount = ex.second.size();
-                    cout << "\nShoroo azmon: " << code << "\n";
-                    float finalGrade = 0;
-
-                    for (int i = 0; i < questionCount; ++i) {
-                        cout << "Soal " << i + 1 << ":\n";
-                        ex.second[i]->ask();
-                        cout << "Javab: ";
-                        string ans;
-                        getline(cin, ans);
-                        total += ex.second[i]->grade(ans);
-
-                        out_sheet << "Soal " << i+1 << ": " << ex.second[i]->text << "\n";
-                        if (ex.second[i]->getType() == "MCQ") {
-                            MultipleChoiceQuestion* mq = dynamic_cast<MultipleChoiceQuestion*>(ex.second[i]);
-                            out_sheet << "Noe: 4-gozine-i\n";
-                            int user_choice=mq->shuffledIndices[std::stoi(ans)-1];
-                            out_sheet << "Pasokh dorost: " << mq->options[mq->correctOptionIndex] << "\n";
-                            out_sheet << "Pasokh shoma: " << mq->options[user_choice] << "\n";
-                            out_sheet << "Vaziyat:"<<(mq->options[mq->correctOptionIndex] == mq->options[user_choice] ? "true" : "false") << std::endl;
-                        } else if (ex.second[i]->getType() == "SA") {
-                            ShortAnswerQuestion* sa = dynamic_cast<ShortAnswerQuestion*>(ex.second[i]);
-                            out_sheet << "Noe: Kootah-pasokh\n";
-                            out_sheet << "Pasokh dorost: " << sa->correctAnswer << "\n";
-                            out_sheet << "Pasokh shoma: " << ans << "\n";
-                            out_sheet << "Vaziyat:"<<(sa->correctAnswer == ans ? "true" : "false") << std::endl;
-
-                        } else if (ex.second[i]->getType() == "DESC") {
-                            DescriptiveQuestion* dq = dynamic_cast<DescriptiveQuestion*>(ex.second[i]);
-                            out_sheet << "Noe: Tashrihi\n";
-                            out_sheet << "Pasokh pishnahadi: " << dq->correctAnswer << "\n";
-                            out_sheet << "Pasokh shoma: " << ans << "\n";
-                            out_sheet << "Vaziyat: be dast-e ostad tas'hih mishavad.\n";
-                        }
-
-
-                        if (ex.second[i]->getType() == "DESC") {
-                            DescriptiveQuestion* dq = dynamic_cast<DescriptiveQuestion*>(ex.second[i]);
-                            ofstream descOut("desc_answ/desc_" + id + "_" + code + ".txt", ios::app);
-                            if (descOut) {
-                                descOut << "Soal " << i + 1 << ": " << dq->text << "\n";
-                                descOut << "Javab daneshjoo: " << dq->getStudentAnswer() << "\n";
-                                descOut << "--------------------------\n";
-                                descOut.close();
-                            }
-                        }
-
-                        cout << "\n-----------------------\n";
-                    }
-
-                    out_sheet.close();
-
-                    finalGrade = total;
-                    examResults[code].push_back({id, finalGrade});
-                    logExamResult(id, code, finalGrade);
-
-
-                    cout << "Azmon ba movafaghiyat anjam shod.\n";
-                    break;
-                }
+void exportExamGrades(Symbol exam, size_t topK) {
+    METRIC_TIMER(TIMER_EXPORT_GRADES);
+    submissions.drain();
+    // The rows are picked and copied under the shard lock, and only if the
+    // results are still the ones the stats were built on (otherwise the
+    // stats are refreshed and the rows picked again), so the list and the
+    // figures below it always agree. The file is written after releasing it.
+    // The stats come first: the cache reads the store itself and the shard
+    // lock isn't reentrant.
+    shared_ptr<const ExamStats> examStats;
+    vector<pair<Symbol, float>> picked;
+    bool current = false;
+    while (!current) {
+        examStats = statsCache.get(exam);
+        picked.clear();
+        bool any = examResults.read(exam, [&](const ExamResults& results) {
+            current = results.version == examStats->resultsVersion;
+            if (!current) return;
+            const auto& entries = results.entries;
+
+            vector<uint32_t> order(entries.size());
+            iota(order.begin(), order.end(), 0);
+            // ties keep the order the results came in
+            auto better = [&](uint32_t a, uint32_t b) {
+                if (entries[a].second != entries[b].second) return entries[a].second > entries[b].second;
+                return a < b;
+            };
+            if (topK > 0 && topK < order.size()) {
+                partial_sort(order.begin(), order.begin() + topK, order.end(), better);
+                order.resize(topK);
+            } else {
+                sort(order.begin(), order.end(), better);
             }
-            if (found) break;
-        }
-
-        if (!found) {
-            cout << "Azmon yaft nashod.\n";
-        }
+            picked.reserve(order.size());
+            for (uint32_t i : order) picked.push_back(entries[i]);
+        });
+        if (!any) break;
     }
-
-    void logExamResult(const string& studentId, const string& examCode, float finalGrade) {
-        ofstream out("grades_db.csv", ios::app);
-        if (!out) {
-            cerr << "Couldn't open grades file.\n";
-            return;
-        }
-
-        out << examCode << "," <<studentId<< "," << finalGrade << "\n";
-        out.close();
-    }
-
-
-    void generateReportCard(string code) {
-        ofstream out("reports/report_" + id + "_" + code + ".txt");
-        if (!out) {
-            cout << "Error: couldn’t create report file.\n";
-            return;
-        }
-
-        vector<Question*>* questions = nullptr;
-        for (Teacher* t : teachers) {
-            for (auto& ex : t->exams) {
-                if (ex.first == code) {
-                    questions = &ex.second;
-                    break;
-                }
-            }
-            if (questions) break;
-        }
-
-        if (!questions) {
-            cout << "Azmon yaft nashod.\n";
-            return;
-        }
-
-
-        float myScore = -1;
-        for (auto& p : examResults[code]) {
-            if (p.first == id) {
-                myScore = p.second;
-                break;
-            }
-        }
-
-        if (myScore < 0) {
-            cout << "Shoma hanuz dar in azmon sherkat nakarde-id.\n";
-            return;
-        }
-
-
-        float totalPositive = 0;
-        for (Question* q : *questions) {
-            totalPositive += q->positiveMark;
-        }
-
-
-        float sum = 0, maxScore = 0;
-        int rank = 1;
-        for (auto& p : examResults[code]) {
-            sum += p.second;
-            if (p.second > maxScore) maxScore = p.second;
-            if (p.second > myScore) rank++;
-        }
-        float avg = examResults[code].empty() ? 0 : sum / examResults[code].size();
-
-        out << "Karname baraye danesh-amooz " << name << " (ID: " << id << ")\n";
-        out << "Code azmon: " << code << "\n\n";
-        out << "Nomre shoma: " << myScore << " az " << totalPositive << "\n";
-        out << "Miyangin nomarat: " << avg << "\n";
-        out << "Bishine nomre: " << maxScore << "\n";
-        out << "Rotbe shoma: " << rank << " az " << examResults[code].size() << "\n\n";
-
-        out << "Joz'iyat soalat:\n";
-        out.close();
-
-
-        ifstream src("sheets/sheet"+ id + "_" + code + ".txt");
-        ofstream dest("reports/report_" + id + "_" + code + ".txt", ios::app);
-        if (!src.is_open()) {
-            cerr << "Error: could not open source file: " << endl;
-            return;
-        }
-        if (!dest.is_open()) {
-            cerr << "Error: could not open destination file: " << endl;
-            return;
-        }
-        string line;
-        while (getline(src, line)) {
-            dest << line << "\n";
-        }
-        src.close();
-        dest.close();
-
-
-
-        cout << "Karname dar file «report_" << id << "_" << code << ".txt» zakhire shod.\n";
-    }
-
-};
-extern vector<Student*> students;
-
-void exportExamGrades(const string& code) {
-    if (examResults.find(code) == examResults.end() || examResults[code].empty()) {
+    if (picked.empty()) {
         cout << "Hich kas dar in azmon sherkat nakarde.\n";
         return;
     }
+    const ScoreStats& stats = examStats->scores;
 
-    vector<pair<string, float>> list = examResults[code];
-
-
-    sort(list.begin(), list.end(), [](auto& a, auto& b) {
-        return a.second > b.second;
-    });
-
+    const string& code = symbols.name(exam);
     ofstream out("grades_" + code + ".txt");
     if (!out) {
         cout << "Error: couldn’t create grades file.\n";
         return;
     }
 
-    float maxScore = 0, sum = 0;
-
-    out << "Liste Nomerat baraye azmon: " << code << "\n";
+    if (topK > 0) out << "Liste " << picked.size() << " nomre-ye bartar baraye azmon: " << code << "\n";
+    else out << "Liste Nomerat baraye azmon: " << code << "\n";
     out << "---------------------------\n";
 
-    for (auto& entry : list) {
+    for (auto& row : picked) {
+        const string& studentId = symbols.name(row.first);
         string studentName = "";
-        for (Student* s : students)
-        if (s->id == entry.first)
+        if (Student* s = dynamic_cast<Student*>(findUser(studentId)))
         studentName = s->name;
 
-        out << "Name: " << studentName << " | ID: " << entry.first
-        << " | Nomre: " << entry.second << "\n";
-
-        if (entry.second > maxScore) maxScore = entry.second;
-        sum += entry.second;
+        out << "Name: " << studentName << " | ID: " << studentId
+        << " | Nomre: " << row.second << "\n";
     }
-
-    float avg = list.empty() ? 0 : sum / list.size();
+    METRIC_COUNT(COUNTER_EXPORTED_ROWS, picked.size());
 
     out << "---------------------------\n";
-    out << "Bishine nomre: " << maxScore << "\n";
-    out << "Miyangin nomarat: " << avg << "\n";
+    out << "Bishine nomre: " << examStats->bestScore << "\n";
+    out << "Miyangin nomarat: " << examStats->exportAverage << "\n";
+    out << "Kamtarin nomre: " << stats.minScore << "\n";
+    out << "Mianeh: " << stats.median << "\n";
+    out << "Enheraf-e meyar: " << stats.stddev << "\n";
+    for (auto& p : stats.percentiles)
+    out << "Sadak " << p.first << ": " << p.second << "\n";
+    out << "Histogram:\n";
+    float width = (stats.maxScore - stats.minScore) / stats.histogram.size();
+    for (size_t b = 0; b < stats.histogram.size(); ++b)
+    out << "  " << stats.minScore + b * width << " - " << stats.minScore + (b + 1) * width
+    << ": " << stats.histogram[b] << "\n";
 
     out.close();
     cout << "File «grades_" << code << ".txt» ba movafaghiyat sakhte shod.\n";
 }
 
-
 vector<Teacher*> teachers;
 vector<Student*> students;
 
-bool isIdUnique(const string& id) {
-    for (const auto& teacher : teachers)
-    if (teacher->id == id) return false;
-    for (const auto& student : students)
-    if (student->id == id) return false;
-    return true;
+bool isIdUnique(string_view id) {
+    return findUser(id) == nullptr;
+}
+
+void rebuildUserDirectory(const vector<Teacher*>& teachers, const vector<Student*>& students) {
+    userDirectory.clear();
+    userDirectory.reserve(teachers.size() + students.size());
+    for (Teacher* t : teachers) addUser(t);
+    for (Student* s : students) addUser(s);
 }
 
 void signup() {
@@ -685,12 +497,22 @@ void signup() {
             cin.ignore();
             getline(cin, courses[i]);
         }
-        teachers.push_back(new Teacher(name, id, password, courses));
+        teachers.push_back(dataArena.make<Teacher>(name, id, password, courses));
+        addUser(teachers.back());
+
+        BinaryWriter rec;
+        writeTeacher(rec, teachers.back());
+        journal.append(JOURNAL_SIGNUP_TEACHER, rec);
     } else {
         cout << "reshte tahsiliye shoma: ";
         cin.ignore();
         getline(cin, major);
-        students.push_back(new Student(name, id, password, teachers, major));
+        students.push_back(dataArena.make<Student>(name, id, password, teachers, major));
+        addUser(students.back());
+
+        BinaryWriter rec;
+        writeStudent(rec, students.back());
+        journal.append(JOURNAL_SIGNUP_STUDENT, rec);
     }
 
     cout << "sabt-nam ba movafaghiyat anjam shod.\n";
@@ -703,31 +525,28 @@ void login() {
     cout << "ramz ra vared konid: ";
     cin >> password;
 
-    for (Teacher* teacher : teachers)
-    if (teacher->id == id && teacher->password == password) {
-        cout << "vorood movafagh!\n";
-        teacher->displayMenu();
-        return;
-    }
-
-    for (Student* student : students)
-    if (student->id == id && student->password == password) {
+    User* user = findUser(id);
+    if (user && user->password == string_view(password)) {
         cout << "vorood movafagh!\n";
-        student->displayMenu();
+        user->displayMenu();
         return;
     }
 
     cout << "ID ya ramz eshtebah ast.\n";
 }
 
+const char SNAPSHOT_MAGIC[4] = {'E', 'X', 'M', 'S'};
+const uint32_t SNAPSHOT_VERSION = 3;
 
-void saveData(const vector<Teacher*>& teachers, const vector<Student*>& students) {
-    ofstream out("data.txt");
+void saveTextData(const string& filename, const vector<Teacher*>& teachers, const vector<Student*>& students) {
+    ofstream out(filename);
     if (!out) {
         cout << "Error: couldn't open file to save.\n";
         return;
     }
 
+    // exams still in the snapshot are decoded one at a time and dropped again
+    ObjectArena scratch;
     out << teachers.size() << "\n";
     for (auto t : teachers) {
         out << t->name << "\n" << t->id << "\n" << t->password << "\n";
@@ -736,12 +555,15 @@ void saveData(const vector<Teacher*>& teachers, const vector<Student*>& students
         out << c << "\n";
 
         out << t->exams.size() << "\n";
-        for (auto& exam : t->exams) {
-            out << exam.first << "\n";
-            out << exam.second.size() << "\n";
-            for (auto* q : exam.second) {
+        for (size_t i = 0; i < t->exams.size(); ++i) {
+            vector<Question*> decoded;
+            const vector<Question*>& questions = t->questionsToSave(i, scratch, decoded);
+            out << symbols.name(t->exams[i].first) << "\n";
+            out << questions.size() << "\n";
+            for (auto* q : questions) {
                 q->save(out);
             }
+            scratch.release();
         }
     }
 
@@ -749,21 +571,31 @@ void saveData(const vector<Teacher*>& teachers, const vector<Student*>& students
     for (auto s : students) {
         out << s->name << "\n" << s->id << "\n" << s->password << "\n" << s->major << "\n";
         out << s->registeredExams.size() << "\n";
-        for (auto& e : s->registeredExams)
-        out << e << "\n";
+        for (Symbol e : s->registeredExams)
+        out << symbols.name(e) << "\n";
+    }
+
+    // optional trailer, so files without blueprints keep their old layout
+    size_t numBlueprints = 0;
+    for (auto t : teachers) numBlueprints += t->blueprints.size();
+    if (numBlueprints > 0) {
+        out << "blueprints\n" << numBlueprints << "\n";
+        for (auto t : teachers)
+        for (auto& exam : t->exams) {
+            auto it = t->blueprints.find(exam.first);
+            if (it == t->blueprints.end()) continue;
+            const ExamBlueprint& b = it->second;
+            out << t->id << "\n" << symbols.name(exam.first) << "\n"
+            << b.count[0] << " " << b.count[1] << " " << b.count[2] << " " << b.totalMarks << "\n";
+        }
     }
 
     out.close();
 }
 
-
-
-void loadData(vector<Teacher*>& teachers, vector<Student*>& students) {
-    ifstream in("data.txt");
-    if (!in) {
-        cout << "No saved data found.\n";
-        return;
-    }
+bool loadTextData(const string& filename, vector<Teacher*>& teachers, vector<Student*>& students, ObjectArena& arena) {
+    ifstream in(filename);
+    if (!in) return false;
 
     int numTeachers;
     in >> numTeachers;
@@ -782,7 +614,7 @@ void loadData(vector<Teacher*>& teachers, vector<Student*>& students) {
         for (int j = 0; j < numCourses; ++j)
         getline(in, courses[j]);
 
-        Teacher* t = new Teacher(name, id, password, courses);
+        Teacher* t = arena.make<Teacher>(name, id, password, courses);
 
         int numExams;
         in >> numExams;
@@ -801,18 +633,13 @@ void loadData(vector<Teacher*>& teachers, vector<Student*>& students) {
             for (int k = 0; k < numQuestions; ++k) {
                 string type;
                 getline(in, type);
-                Question* q = nullptr;
-
-                if (type == "MCQ") q = new MultipleChoiceQuestion();
-                else if (type == "SA") q = new ShortAnswerQuestion();
-                else if (type == "DESC") q = new DescriptiveQuestion();
-
+                Question* q = makeQuestion(type, arena);
                 if (q) {
                     q->load(in);
                     qList.push_back(q);
                 }
             }
-            t->exams.push_back({code, qList});
+            t->exams.push_back({symbols.intern(code), qList});
         }
 
         teachers.push_back(t);
@@ -828,98 +655,1159 @@ void loadData(vector<Teacher*>& teachers, vector<Student*>& students) {
         getline(in, password);
         getline(in, major);
 
-        Student* s = new Student(name, id, password, teachers, major);
+        Student* s = arena.make<Student>(name, id, password, teachers, major);
 
         int numRegs;
         in >> numRegs;
         in.ignore();
+        if (in && numRegs > 0) s->reserveRegistrations(min(numRegs, 4096));
         for (int j = 0; j < numRegs; ++j) {
             string examCode;
             getline(in, examCode);
-            s->registeredExams.push_back(examCode);
+            s->restoreRegistration(symbols.intern(examCode));
         }
 
         students.push_back(s);
     }
 
+    string tag;
+    if (getline(in, tag) && tag == "blueprints") {
+        int numBlueprints;
+        in >> numBlueprints;
+        in.ignore();
+        for (int i = 0; i < numBlueprints && in; ++i) {
+            string teacherId, code;
+            getline(in, teacherId);
+            getline(in, code);
+            ExamBlueprint b;
+            in >> b.count[0] >> b.count[1] >> b.count[2] >> b.totalMarks;
+            in.ignore();
+            for (Teacher* t : teachers)
+            if (t->id == string_view(teacherId)) t->blueprints[symbols.intern(code)] = b;
+        }
+    }
+
     in.close();
+    return true;
 }
 
+void writeTeacher(BinaryWriter& w, const Teacher* t, SnapshotExams* exams) {
+    w.str(t->name);
+    w.str(t->id);
+    w.str(t->password);
+    w.u32(t->courses.size());
+    for (auto& c : t->courses) w.str(c);
+
+    // the snapshot's pool may point into scratch until the file is written
+    ObjectArena local;
+    ObjectArena& scratch = exams ? exams->scratch : local;
+    if (exams) w.u32(exams->count);
+    w.u32(t->exams.size());
+    for (size_t i = 0; i < t->exams.size(); ++i) {
+        vector<Question*> decoded;
+        const vector<Question*>& questions = t->questionsToSave(i, scratch, decoded);
+        if (exams) exams->add(symbols.name(t->exams[i].first), questions);
+        else writeExam(w, symbols.name(t->exams[i].first), questions);
+    }
 
-void freeMemory(vector<Teacher*>& teachers, vector<Student*>& students) {
+    w.u32(t->blueprints.size());
+    for (auto& exam : t->exams) {
+        auto it = t->blueprints.find(exam.first);
+        if (it == t->blueprints.end()) continue;
+        w.str(symbols.name(exam.first));
+        writeBlueprint(w, it->second);
+    }
+}
+
+void writeStudent(BinaryWriter& w, const Student* s) {
+    w.str(s->name);
+    w.str(s->id);
+    w.str(s->password);
+    w.str(s->major);
+    w.u32(s->registeredExams.size());
+    for (Symbol e : s->registeredExams) w.str(symbols.name(e));
+}
+
+Teacher* readTeacher(BinaryReader& r, ObjectArena& arena, bool withBlueprints, SnapshotImage* image) {
+    string_view name = r.view(), id = r.view(), password = r.view();
+    vector<string> courses(r.ok ? r.u32() : 0);
+    for (auto& c : courses) c = r.str();
+
+    Teacher* t = arena.make<Teacher>(name, id, password, courses);
+    if (image) {
+        uint32_t first = r.u32(), numExams = r.u32();
+        if (!r.ok || uint64_t(first) + numExams > image->numExams) {
+            r.ok = false;
+            return t;
+        }
+        t->exams.reserve(numExams);
+        for (uint32_t j = 0; j < numExams; ++j)
+        t->exams.push_back({symbols.intern(image->strings.at(image->examField(first + j, 0))), {}});
+        t->snapshot = image;
+        t->snapshotFirstExam = first;
+        t->snapshotExams = numExams;
+    }
+    uint32_t numExams = image ? 0 : r.u32();
+    for (uint32_t j = 0; j < numExams && r.ok; ++j) {
+        string code;
+        vector<Question*> qList;
+        readExam(r, code, qList, arena);
+        t->exams.push_back({symbols.intern(code), qList});
+    }
+
+    // journal signups written before blueprints existed end right here
+    uint32_t numBlueprints = withBlueprints && r.pos != r.end ? r.u32() : 0;
+    for (uint32_t j = 0; j < numBlueprints && r.ok; ++j) {
+        Symbol exam = symbols.intern(r.str());
+        t->blueprints[exam] = readBlueprint(r);
+    }
+    return t;
+}
+
+Student* readStudent(BinaryReader& r, vector<Teacher*>& teachers, ObjectArena& arena) {
+    string_view name = r.view(), id = r.view(), password = r.view(), major = r.view();
+    Student* s = arena.make<Student>(name, id, password, teachers, major);
+    uint32_t numRegs = r.u32();
+    // each registration takes at least its 4-byte length
+    if (r.ok) s->reserveRegistrations(min<size_t>(numRegs, size_t(r.end - r.pos) / 4));
+    for (uint32_t j = 0; j < numRegs && r.ok; ++j)
+    s->restoreRegistration(symbols.intern(r.view()));
+    return s;
+}
+
+bool saveSnapshot(const string& filename, const vector<Teacher*>& teachers, const vector<Student*>& students) {
+    StringPool pool;
+    SnapshotExams exams;
+    exams.table.pool = exams.questions.pool = &pool;
+    BinaryWriter records;
+    records.pool = &pool;
+    vector<uint64_t> offsets;
+    offsets.reserve(teachers.size() + students.size());
     for (auto t : teachers) {
-        for (auto& exam : t->exams) {
-            for (Question* q : exam.second) {
-                delete q;
+        offsets.push_back(records.buf.size());
+        writeTeacher(records, t, &exams);
+    }
+    for (auto s : students) {
+        offsets.push_back(records.buf.size());
+        writeStudent(records, s);
+    }
+
+    // every table has a fixed size, so the sections' positions are known
+    // before anything is written
+    uint64_t recordsAt = 4 + 6 * 4 + 8 * uint64_t(offsets.size()) + 12 * uint64_t(exams.count)
+    + 8 * (exams.questionOffsets.size() + 1) + 8 * (pool.strings.size() + 1);
+    uint64_t questionsAt = recordsAt + records.buf.size();
+    uint64_t stringsAt = questionsAt + exams.questions.buf.size();
+
+    BinaryWriter header;
+    header.bytes(SNAPSHOT_MAGIC, 4);
+    header.u32(SNAPSHOT_VERSION);
+    header.u32(teachers.size());
+    header.u32(students.size());
+    header.u32(exams.count);
+    header.u32(exams.questionOffsets.size());
+    header.u32(pool.strings.size());
+    for (uint64_t off : offsets) header.u64(recordsAt + off);
+    header.bytes(exams.table.buf.data(), exams.table.buf.size());
+    for (uint64_t off : exams.questionOffsets) header.u64(questionsAt + off);
+    header.u64(stringsAt);
+    BinaryWriter text;
+    for (string_view s : pool.strings) {
+        header.u64(stringsAt + text.buf.size());
+        text.buf.append(s);
+    }
+    header.u64(stringsAt + text.buf.size());
+    assert(header.buf.size() == recordsAt);
+
+    // the data has to be on disk before the rename publishes it, and the
+    // rename has to be on disk before the caller truncates the journal
+    string tmp = filename + ".tmp";
+    FILE* out = fopen(tmp.c_str(), "wb");
+    if (!out) return false;
+    bool ok = true;
+    for (const BinaryWriter* part : {&header, &records, &exams.questions, &text})
+    ok = ok && fwrite(part->buf.data(), 1, part->buf.size(), out) == part->buf.size();
+    ok = syncFile(out) && ok;
+    ok = fclose(out) == 0 && ok;
+    error_code ec;
+    if (!ok) {
+        filesystem::remove(tmp, ec);
+        return false;
+    }
+
+    filesystem::rename(tmp, filename, ec);
+    return !ec && syncDirectory(filename);
+}
+
+bool syncFile(FILE* file) {
+    if (fflush(file) != 0) return false;
+#ifdef _WIN32
+    return _commit(_fileno(file)) == 0;
+#else
+    return fsync(fileno(file)) == 0;
+#endif
+}
+
+bool syncDirectory(const string& path) {
+#ifdef _WIN32
+    (void)path;
+    return true;
+#else
+    string dir = filesystem::path(path).parent_path().string();
+    int fd = ::open(dir.empty() ? "." : dir.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    bool ok = fsync(fd) == 0;
+    ::close(fd);
+    return ok;
+#endif
+}
+
+bool readWholeFile(const string& filename, string& data) {
+    error_code ec;
+    if (!filesystem::is_regular_file(filename, ec)) return false;
+    ifstream in(filename, ios::binary | ios::ate);
+    if (!in) return false;
+    streamoff size = in.tellg();
+    if (size < 0) return false;
+    data.resize(size_t(size));
+    in.seekg(0);
+    in.read(&data[0], data.size());
+    return bool(in);
+}
+
+bool MappedFile::open(const string& filename) {
+    close();
+#ifdef _WIN32
+    if (!readWholeFile(filename, copy)) return false;
+    data = copy.data();
+    size = copy.size();
+    return true;
+#else
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    bool ok = fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0;
+    void* at = ok ? mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    // the mapping keeps the file alive, even once a save renames a new one over it
+    ::close(fd);
+    if (at == MAP_FAILED) return false;
+    data = static_cast<const char*>(at);
+    size = size_t(st.st_size);
+    return true;
+#endif
+}
+
+void MappedFile::close() {
+#ifndef _WIN32
+    if (data) munmap(const_cast<char*>(data), size);
+#endif
+    copy.clear();
+    data = nullptr;
+    size = 0;
+}
+
+void SnapshotImage::decodeExam(uint32_t exam, ObjectArena& arena, vector<Question*>& questions) const {
+    uint32_t first = examField(exam, 1), count = examField(exam, 2);
+    size_t before = questions.size();
+    bool ok = true;
+    for (uint32_t k = first; k < first + count && ok; ++k) {
+        uint64_t range[2];
+        memcpy(range, questionOffsets + 8 * size_t(k), 16);
+        BinaryReader r(file.data + range[0], file.data + range[1]);
+        r.pool = &strings;
+        Question* q = makeQuestion(r.view(), arena);
+        if (q) q->loadBinary(r);
+        ok = q && r.ok;
+        if (ok) questions.push_back(q);
+    }
+    if (!ok) {
+        questions.resize(before);
+        cerr << "Snapshot: soalat-e azmon " << strings.at(examField(exam, 0)) << " kharab ast.\n";
+    }
+}
+
+// offsets must not decrease and must stay within [from, to]
+bool offsetsInRange(const char* table, size_t n, uint64_t from, uint64_t to) {
+    for (size_t i = 0; i < n; ++i) {
+        uint64_t off;
+        memcpy(&off, table + 8 * i, 8);
+        if (off < from || off > to) return false;
+        from = off;
+    }
+    return true;
+}
+
+bool loadSnapshot(const string& filename, vector<Teacher*>& teachers, vector<Student*>& students, ObjectArena& arena) {
+    auto image = make_unique<SnapshotImage>();
+    if (!image->file.open(filename)) return false;
+    const char* data = image->file.data;
+    size_t size = image->file.size;
+
+    BinaryReader header(data, data + size);
+    char magic[4];
+    header.bytes(magic, 4);
+    uint32_t version = header.u32();
+    uint32_t numTeachers = header.u32();
+    uint32_t numStudents = header.u32();
+    if (!header.ok || memcmp(magic, SNAPSHOT_MAGIC, 4) != 0 || version < 1 || version > SNAPSHOT_VERSION) {
+        cerr << "Snapshot " << filename << " motabar nist.\n";
+        return false;
+    }
+
+    bool lazy = version >= 3;
+    uint32_t numStrings = 0;
+    if (lazy) {
+        image->numExams = header.u32();
+        image->numQuestions = header.u32();
+        numStrings = header.u32();
+    }
+    uint64_t numRecords = numTeachers + uint64_t(numStudents);
+    uint64_t tablesEnd = uint64_t(header.pos - data) + 8 * numRecords;
+    if (lazy) tablesEnd += 12 * uint64_t(image->numExams) + 8 * (uint64_t(image->numQuestions) + 1) + 8 * (uint64_t(numStrings) + 1);
+    if (!header.ok || tablesEnd > size) {
+        cerr << "Snapshot " << filename << " kharab ast.\n";
+        return false;
+    }
+    vector<uint64_t> offsets(numRecords);
+    for (auto& off : offsets) off = header.u64();
+
+    if (lazy) {
+        image->examTable = header.pos;
+        image->questionOffsets = image->examTable + 12 * size_t(image->numExams);
+        image->strings.base = data;
+        image->strings.offsets = image->questionOffsets + 8 * (size_t(image->numQuestions) + 1);
+        image->strings.count = numStrings;
+        // checked once here, so decoding an exam later never reads outside the file
+        bool tablesOk = offsetsInRange(image->questionOffsets, size_t(image->numQuestions) + 1, tablesEnd, size)
+        && offsetsInRange(image->strings.offsets, size_t(numStrings) + 1, tablesEnd, size);
+        for (uint32_t e = 0; e < image->numExams && tablesOk; ++e)
+        tablesOk = image->examField(e, 0) < numStrings
+        && uint64_t(image->examField(e, 1)) + image->examField(e, 2) <= image->numQuestions;
+        if (!tablesOk) {
+            cerr << "Snapshot " << filename << " kharab ast.\n";
+            return false;
+        }
+        image->decoded.reset(new atomic<bool>[image->numExams]());
+    }
+
+    // every record starts at its own offset, so ranges of records decode
+    // independently into fixed slots and the result order never depends on
+    // the thread count
+    vector<Teacher*> loadedTeachers(numTeachers, nullptr);
+    vector<Student*> loadedStudents(numStudents, nullptr);
+    vector<char> recordOk(numRecords, 0);
+    auto loaded = make_unique<ObjectArena>();
+    mutex loadedLock;
+    parallelFor(numRecords, 256, [&](size_t begin, size_t end) {
+        auto local = make_unique<ObjectArena>();
+        for (size_t i = begin; i < end; ++i) {
+            if (offsets[i] >= size) continue;
+            BinaryReader r(data + offsets[i], data + size);
+            if (lazy) r.pool = &image->strings;
+            if (i < numTeachers) loadedTeachers[i] = readTeacher(r, *local, version >= 2, lazy ? image.get() : nullptr);
+            else loadedStudents[i - numTeachers] = readStudent(r, teachers, *local);
+            recordOk[i] = r.ok;
+        }
+        lock_guard<mutex> guard(loadedLock);
+        loaded->adopt(move(local));
+    });
+    bool ok = find(recordOk.begin(), recordOk.end(), 0) == recordOk.end();
+
+    if (!ok) {
+        cerr << "Snapshot " << filename << " kharab ast.\n";
+        return false;
+    }
+
+    arena.adopt(move(loaded));
+    // older versions were decoded in full and need the file no longer
+    if (lazy) arena.adopt(move(image));
+    teachers.insert(teachers.end(), loadedTeachers.begin(), loadedTeachers.end());
+    students.insert(students.end(), loadedStudents.begin(), loadedStudents.end());
+    return true;
+}
+
+void applyJournalRecord(BinaryReader& r, vector<Teacher*>& teachers, vector<Student*>& students) {
+    // records decode straight into dataArena. A signup the snapshot already
+    // has (the journal outlived a save) is recognized by its ID and skipped
+    // undecoded; a rejected exam record stays in the arena until exit.
+    uint8_t kind = r.u8();
+    if (kind == JOURNAL_SIGNUP_TEACHER || kind == JOURNAL_SIGNUP_STUDENT) {
+        BinaryReader peek = r;
+        peek.str();
+        if (!isIdUnique(peek.str())) return;
+    }
+    switch (kind) {
+        case JOURNAL_SIGNUP_TEACHER: {
+            Teacher* t = readTeacher(r, dataArena);
+            if (r.ok) {
+                teachers.push_back(t);
+                addUser(t);
             }
+            break;
+        }
+        case JOURNAL_SIGNUP_STUDENT: {
+            Student* s = readStudent(r, teachers, dataArena);
+            if (r.ok) {
+                students.push_back(s);
+                addUser(s);
+            }
+            break;
+        }
+        case JOURNAL_CREATE_EXAM: {
+            string teacherId = r.str(), code;
+            vector<Question*> questions;
+            readExam(r, code, questions, dataArena);
+            Teacher* t = dynamic_cast<Teacher*>(findUser(teacherId));
+            if (r.ok && t && !lookupExam(code)) t->publishExam(code, questions);
+            break;
+        }
+        case JOURNAL_IMPORT_EXAMS: {
+            string teacherId = r.str();
+            uint32_t count = r.u32();
+            vector<pair<string, vector<Question*>>> imported;
+            for (uint32_t k = 0; k < count && r.ok; ++k) {
+                imported.emplace_back();
+                readExam(r, imported.back().first, imported.back().second, dataArena);
+            }
+            Teacher* t = dynamic_cast<Teacher*>(findUser(teacherId));
+            // all or nothing, as when the file was imported
+            bool clash = false;
+            for (auto& exam : imported) clash = clash || lookupExam(exam.first);
+            if (r.ok && t && !clash)
+            for (auto& exam : imported) t->publishExam(exam.first, exam.second);
+            break;
+        }
+        case JOURNAL_SET_BLUEPRINT: {
+            string code = r.str();
+            ExamBlueprint blueprint = readBlueprint(r);
+            string error = r.ok ? setBlueprint(symbols.find(code), blueprint) : "";
+            if (!error.empty()) cerr << "Journal: tarkib-e azmon " << code << " emal nashod: " << error << "\n";
+            break;
+        }
+        case JOURNAL_REGISTER: {
+            string studentId = r.str(), code = r.str();
+            if (Student* s = dynamic_cast<Student*>(findUser(studentId)))
+            s->registerFor(symbols.find(code));
+            break;
         }
-        delete t;
     }
+}
 
-    for (auto s : students) {
-        delete s;
+size_t replayJournal(const string& filename, vector<Teacher*>& teachers, vector<Student*>& students) {
+    string data;
+    if (!readWholeFile(filename, data)) return 0;
+
+    size_t pos = 0, applied = 0;
+    while (data.size() - pos >= 8) {
+        uint32_t len, sum;
+        memcpy(&len, data.data() + pos, 4);
+        memcpy(&sum, data.data() + pos + 4, 4);
+        if (len == 0 || data.size() - pos - 8 < len || checksum(data.data() + pos + 8, len) != sum) break;
+
+        BinaryReader r(data.data() + pos + 8, data.data() + pos + 8 + len);
+        applyJournalRecord(r, teachers, students);
+        pos += 8 + len;
+        applied++;
     }
 
+    if (pos != data.size()) {
+        cerr << "Journal: " << data.size() - pos << " byte-e nakamel dar enteha-ye " << filename << " dor rikhte shod.\n";
+        error_code ec;
+        filesystem::resize_file(filename, pos, ec);
+    }
+    return applied;
+}
+
+bool compactJournal(const vector<Teacher*>& teachers, const vector<Student*>& students) {
+    if (!saveSnapshot(SNAPSHOT_FILE, teachers, students)) return false;
+    // a journal that could not be emptied is reported by reset and is only
+    // replayed as duplicates, so the snapshot still counts as saved
+    journal.reset();
+    return true;
+}
+
+void loadData(vector<Teacher*>& teachers, vector<Student*>& students, const function<void()>& beforeReplay) {
+    METRIC_TIMER(TIMER_LOAD_DATA);
+    bool loaded = loadSnapshot(SNAPSHOT_FILE, teachers, students, dataArena);
+    if (!loaded) loaded = loadTextData(LEGACY_DATA_FILE, teachers, students, dataArena);
+    if (!loaded) cout << "No saved data found.\n";
+
+    rebuildExamIndex(teachers);
+    rebuildUserDirectory(teachers, students);
+    if (beforeReplay) beforeReplay();
+
+    if (replayJournal(JOURNAL_FILE, teachers, students) > 0)
+    compactJournal(teachers, students);
+}
+
+void saveData(const vector<Teacher*>& teachers, const vector<Student*>& students) {
+    METRIC_TIMER(TIMER_SAVE_DATA);
+    if (!compactJournal(teachers, students))
+    cout << "Error: couldn't open file to save.\n";
+}
+
+bool importTextData(vector<Teacher*>& teachers, vector<Student*>& students) {
+    if (!loadTextData(LEGACY_DATA_FILE, teachers, students, dataArena)) return false;
+    rebuildExamIndex(teachers);
+    rebuildUserDirectory(teachers, students);
+    return compactJournal(teachers, students);
+}
+
+void freeMemory(vector<Teacher*>& teachers, vector<Student*>& students) {
+    examIndex.clear();
+    userDirectory.clear();
+    statsCache.clear();
+    questionBanks.clear();
+    attempts.clear();
     teachers.clear();
     students.clear();
+    dataArena.release();
 }
 
+bool parseGrade(const char* begin, const char* end, float& grade) {
+    while (begin < end && isspace(uint8_t(*begin))) begin++;
+    if (begin < end && *begin == '+') begin++;
+    auto res = from_chars(begin, end, grade);
+    return res.ec == errc();
+}
 
-map<string, vector<pair<string, float>>> readExamResults(const string& filename) {
-    map<string, vector<pair<string, float>>> examResults;
-    ifstream inputFile(filename);
-    string line;
-    while (getline(inputFile, line)) {
-        stringstream ss(line);
-        string courseID, studentID, gradeStr;
-        float grade;
-
-        if (getline(ss, courseID, ',') &&
-        getline(ss, studentID, ',') &&
-        getline(ss, gradeStr)) {
-
-            try {
-                grade = stof(gradeStr);
-                examResults[courseID].emplace_back(studentID, grade);
-            } catch (const invalid_argument& e) {
-                cerr << "Invalid grade in line: " << line << endl;
+void parseResultRows(const char* p, const char* end, unordered_map<Symbol, ExamResults>& examResults, vector<string_view>& invalid) {
+    vector<string_view> codes, studentIds;
+    vector<size_t> codeOf;
+    vector<float> grades;
+    while (p < end) {
+        const char* eol = static_cast<const char*>(memchr(p, '\n', end - p));
+        if (!eol) eol = end;
+
+        const char* c1 = static_cast<const char*>(memchr(p, ',', eol - p));
+        const char* c2 = c1 ? static_cast<const char*>(memchr(c1 + 1, ',', eol - c1 - 1)) : nullptr;
+        if (c2 && c2 + 1 < eol) {
+            float grade;
+            if (parseGrade(c2 + 1, eol, grade)) {
+                string_view code(p, c1 - p);
+                if (codes.empty() || code != codes.back()) codes.push_back(code);
+                codeOf.push_back(codes.size() - 1);
+                studentIds.emplace_back(c1 + 1, c2 - c1 - 1);
+                grades.push_back(grade);
+            } else {
+                invalid.emplace_back(p, eol - p);
             }
         }
+        p = eol + 1;
+    }
+
+    vector<Symbol> codeSyms = symbols.internAll(codes), idSyms = symbols.internAll(studentIds);
+    ExamResults* last = nullptr;
+    for (size_t i = 0; i < grades.size(); ++i) {
+        if (!last || codeSyms[codeOf[i]] != codeSyms[codeOf[i - 1]]) last = &examResults[codeSyms[codeOf[i]]];
+        last->append(idSyms[i], grades[i]);
+    }
+}
+
+unordered_map<Symbol, ExamResults> readExamResults(const string& filename) {
+    METRIC_TIMER(TIMER_READ_EXAM_RESULTS);
+    unordered_map<Symbol, ExamResults> examResults;
+    string data;
+    if (!readWholeFile(filename, data)) return examResults;
+
+    const size_t minChunk = 1 << 20;
+    size_t numChunks = max<size_t>(1, min<size_t>(thread::hardware_concurrency(), data.size() / minChunk));
+    vector<const char*> bounds = {data.data()};
+    const char* end = data.data() + data.size();
+    for (size_t i = 1; i < numChunks; ++i) {
+        const char* guess = max<const char*>(bounds.back(), data.data() + data.size() * i / numChunks);
+        const char* eol = static_cast<const char*>(memchr(guess, '\n', end - guess));
+        bounds.push_back(eol ? eol + 1 : end);
+    }
+    bounds.push_back(end);
+
+    vector<unordered_map<Symbol, ExamResults>> partials(numChunks);
+    vector<vector<string_view>> invalid(numChunks);
+    parallelFor(numChunks, 1, [&](size_t begin, size_t last) {
+        for (size_t i = begin; i < last; ++i)
+        parseResultRows(bounds[i], bounds[i + 1], partials[i], invalid[i]);
+    });
+
+    for (size_t i = 0; i < numChunks; ++i) {
+        METRIC_COUNT(COUNTER_INVALID_GRADE_ROWS, invalid[i].size());
+        for (auto& line : invalid[i])
+        cerr << "Invalid grade in line: " << line << endl;
+
+        if (i == 0) {
+            examResults = move(partials[0]);
+            continue;
+        }
+        for (auto& exam : partials[i]) {
+            ExamResults& target = examResults[exam.first];
+            for (auto& e : exam.second.entries) target.append(e.first, e.second);
+        }
     }
 
-    inputFile.close();
+    for (auto& exam : examResults) exam.second.buildRankIndex();
     return examResults;
 }
 
+void gradeBatch(const string& filename) {
+    METRIC_TIMER(TIMER_GRADE_BATCH);
+    string data;
+    if (!readWholeFile(filename, data)) {
+        cout << "File " << filename << " baz nashod.\n";
+        return;
+    }
 
+    struct Submission {
+        size_t line;
+        string code;
+        string studentId;
+        Symbol exam = NO_SYMBOL;
+        vector<string> answers;
+        bool found = false;
+        float total = 0;
+        string sheet;
+        string descAnswers;
+    };
 
+    vector<Submission> subs;
+    istringstream in(data);
+    string line;
+    for (size_t lineNo = 1; getline(in, line); ++lineNo) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (line.empty()) continue;
+
+        Submission sub;
+        sub.line = lineNo;
+        istringstream fields(line);
+        string field;
+        getline(fields, sub.code, '\t');
+        getline(fields, sub.studentId, '\t');
+        while (getline(fields, field, '\t')) sub.answers.push_back(field);
+        sub.exam = symbols.find(sub.code);
+        subs.push_back(move(sub));
+    }
 
-int main() {
-    loadData(teachers, students);
-    examResults=readExamResults("grades_db.csv");
+    // exams drawn per student have no single key; they are graded one by one
+    unordered_map<Symbol, ExamKey> keys;
+    for (const Submission& sub : subs) {
+        if (keys.count(sub.exam) || findBlueprint(sub.exam)) continue;
+        if (vector<Question*>* questions = findExam(sub.exam)) keys.emplace(sub.exam, ExamKey(*questions));
+    }
 
-    int choice;
-    do {
-        cout << "\n1. Signup\n2. Login\n3. Exit\nChoice: ";
-        cin >> choice;
-        cin.ignore();
+    auto start = chrono::steady_clock::now();
 
-        switch (choice) {
-            case 1:
-            signup();
-            break;
-            case 2:
-            login();
-            break;
-            case 3:
-            saveData(teachers, students);
-            break;
-            default:
-            cout << "Invalid choice.\n";
+    // exams made only of MCQs are scored as whole answer matrices
+    map<Symbol, vector<size_t>> mcqRows;
+    for (size_t i = 0; i < subs.size(); ++i) {
+        auto key = keys.find(subs[i].exam);
+        if (key != keys.end() && key->second.allMcq()) mcqRows[subs[i].exam].push_back(i);
+    }
+    for (auto& exam : mcqRows) {
+        const ExamKey& key = keys.at(exam.first);
+        const vector<size_t>& rows = exam.second;
+        size_t nq = key.size();
+        vector<uint8_t> answers(rows.size() * nq, 0xFF), correct(nq);
+        for (size_t q = 0; q < nq; ++q) {
+            correct[q] = uint8_t(key.correctOption[q]);
+            // 0xFF is the kernel's "no answer"; as a key it would reward every blank
+            assert(correct[q] != 0xFF);
         }
-    } while (choice != 3);
+        for (size_t r = 0; r < rows.size(); ++r) {
+            const vector<string>& given = subs[rows[r]].answers;
+            for (size_t q = 0; q < nq && q < given.size(); ++q) answers[r * nq + q] = uint8_t(parseChoice(given[q]));
+        }
+
+        vector<float> totals(rows.size());
+        parallelFor(rows.size(), 1024, [&](size_t begin, size_t end) {
+            scoreMcqMatrix(answers.data() + begin * nq, correct.data(), 0, end - begin, nq,
+            key.positive.data(), key.negative.data(), totals.data() + begin);
+        });
+        for (size_t r = 0; r < rows.size(); ++r) subs[rows[r]].total = totals[r];
+    }
+
+    parallelFor(subs.size(), 64, [&](size_t begin, size_t end) {
+        vector<uint8_t> hit;
+        vector<float> marks;
+        for (size_t i = begin; i < end; ++i) {
+            Submission& sub = subs[i];
+            auto key = keys.find(sub.exam);
+            if (key == keys.end()) {
+                if (!findBlueprint(sub.exam)) continue;
+                // the answers follow the student's own questions
+                sub.found = true;
+                ExamSession session(sub.code, sub.studentId, examQuestionsFor(sub.exam, sub.studentId), false);
+                for (size_t q = 0; q < session.questions.size(); ++q)
+                session.record(q, q < sub.answers.size() ? sub.answers[q] : "");
+                sub.total = session.gradeAll();
+                sub.sheet = session.sheet();
+                sub.descAnswers = session.descriptiveAnswers();
+                continue;
+            }
+
+            sub.found = true;
+            if (!key->second.allMcq()) sub.total = key->second.score(sub.answers, hit, marks);
 
-    return 0;
+            ExamSession session(sub.code, sub.studentId, *findExam(sub.exam), false);
+            for (size_t q = 0; q < key->second.size(); ++q)
+            session.record(q, q < sub.answers.size() ? sub.answers[q] : "");
+            sub.sheet = session.sheet();
+            sub.descAnswers = session.descriptiveAnswers();
+        }
+    });
+    double gradeSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    size_t graded = 0;
+    unordered_map<Symbol, vector<pair<Symbol, float>>> byExam;
+    for (Submission& sub : subs) {
+        if (!sub.found) {
+            cerr << "Khat " << sub.line << ": azmon " << sub.code << " yaft nashod.\n";
+            continue;
+        }
+        gradeSink.replace(sheetPath(sub.studentId, sub.code), sub.sheet);
+        if (!sub.descAnswers.empty())
+        gradeSink.append("desc_answ/desc_" + sub.studentId + "_" + sub.code + ".txt", sub.descAnswers);
+        Symbol student = symbols.intern(sub.studentId);
+        byExam[sub.exam].emplace_back(student, sub.total);
+        logExamResult(sub.studentId, sub.code, sub.total);
+        graded++;
+    }
+    for (auto& exam : byExam) examResults.addAll(exam.first, exam.second);
+    gradeSink.flush();
+    METRIC_COUNT(COUNTER_BATCH_SUBMISSIONS, graded);
+
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << graded << " pasokh-name tas'hih shod dar " << seconds << " s ("
+    << (seconds > 0 ? graded / seconds : 0) << " dar saniye, tas'hih: " << gradeSeconds << " s).\n";
 }
 
+// Splits one CSV record. Quoted fields may hold commas, and "" stands for a
+// quote inside them; false on an unterminated quote.
+bool splitCsvFields(string_view line, vector<string>& fields) {
+    fields.clear();
+    size_t i = 0;
+    while (true) {
+        string field;
+        if (i < line.size() && line[i] == '"') {
+            for (++i; ; ++i) {
+                if (i >= line.size()) return false;
+                if (line[i] != '"') field += line[i];
+                else if (i + 1 < line.size() && line[i + 1] == '"') field += line[++i];
+                else break;
+            }
+            ++i;
+            if (i < line.size() && line[i] != ',') return false;
+        } else {
+            size_t stop = min(line.find(',', i), line.size());
+            field.assign(line.substr(i, stop - i));
+            i = stop;
+        }
+        fields.push_back(move(field));
+        if (i >= line.size()) return true;
+        ++i;
+    }
+}
+
+// the whole field has to be the number, surrounding blanks aside
+bool parseImportNumber(const string& s, float& value) {
+    const char* b = s.data();
+    const char* e = b + s.size();
+    while (b < e && isspace(uint8_t(*b))) b++;
+    while (e > b && isspace(uint8_t(e[-1]))) e--;
+    if (b < e && *b == '+') b++;
+    auto res = from_chars(b, e, value);
+    return b < e && res.ec == errc() && res.ptr == e;
+}
+
+bool parseImportType(const string& s, QuestionType& type) {
+    if (s == "MCQ") type = QuestionType::MCQ;
+    else if (s == "SA") type = QuestionType::SA;
+    else if (s == "DESC") type = QuestionType::DESC;
+    else return false;
+    return true;
+}
+
+bool parseImportCorrect(const string& s, int& correct) {
+    float value;
+    if (!parseImportNumber(s, value) || value != int(value)) return false;
+    correct = int(value);
+    return true;
+}
 
+void parseImportCsv(string_view line, ImportRow& row) {
+    vector<string> f;
+    if (!splitCsvFields(line, f)) {
+        row.error = "giume baste nashode";
+        return;
+    }
+    if (f.size() < 2 || !parseImportType(f[1], row.type)) {
+        row.error = "noe-e soal bayad MCQ, SA ya DESC bashad";
+        return;
+    }
+    // MCQ rows have however many options were given; validateImportRow counts them
+    size_t expected = row.type == QuestionType::MCQ ? max<size_t>(f.size(), 7) : row.type == QuestionType::SA ? 6 : 5;
+    if (f.size() != expected) {
+        row.error = to_string(expected) + " sotoon lazem ast, " + to_string(f.size()) + " dade shod";
+        return;
+    }
+
+    row.code = f[0];
+    row.text = f[2];
+    if (!parseImportNumber(f[3], row.positive)) {
+        row.error = "nomre-ye mosbat adad nist";
+        return;
+    }
+    if (row.type == QuestionType::DESC) {
+        row.answer = f[4];
+        return;
+    }
+    if (!parseImportNumber(f[4], row.negative)) {
+        row.error = "nomre-ye manfi adad nist";
+        return;
+    }
+    if (row.type == QuestionType::SA) {
+        row.answer = f[5];
+        return;
+    }
+    row.options.assign(f.begin() + 5, f.end() - 1);
+    if (!parseImportCorrect(f.back(), row.correct)) row.error = "shomare gozine dorost adad nist";
+}
+
+// Just enough JSON for one flat object per line: string, number and
+// array-of-string values. Numbers are kept as their text.
+class JsonLine {
+    public:
+    const char* p;
+    const char* end;
+    map<string, string> scalars;
+    map<string, vector<string>> arrays;
+
+    JsonLine(string_view line) : p(line.data()), end(line.data() + line.size()) {}
+
+    void skip() {
+        while (p < end && isspace(uint8_t(*p))) p++;
+    }
+
+    bool eat(char c) {
+        skip();
+        if (p >= end || *p != c) return false;
+        p++;
+        return true;
+    }
+
+    static void putUtf8(string& out, uint32_t cp) {
+        if (cp < 0x80) out += char(cp);
+        else if (cp < 0x800) out += {char(0xC0 | cp >> 6), char(0x80 | (cp & 0x3F))};
+        else if (cp < 0x10000) out += {char(0xE0 | cp >> 12), char(0x80 | (cp >> 6 & 0x3F)), char(0x80 | (cp & 0x3F))};
+        else out += {char(0xF0 | cp >> 18), char(0x80 | (cp >> 12 & 0x3F)), char(0x80 | (cp >> 6 & 0x3F)), char(0x80 | (cp & 0x3F))};
+    }
+
+    bool hex4(uint32_t& cp) {
+        if (end - p < 4) return false;
+        auto res = from_chars(p, p + 4, cp, 16);
+        if (res.ptr != p + 4) return false;
+        p += 4;
+        return true;
+    }
+
+    bool str(string& out) {
+        if (!eat('"')) return false;
+        out.clear();
+        while (p < end && *p != '"') {
+            if (*p != '\\') {
+                out += *p++;
+                continue;
+            }
+            if (++p >= end) return false;
+            char c = *p++;
+            switch (c) {
+                case 'n': out += '\n'; break;
+                case 't': out += '\t'; break;
+                case 'r': out += '\r'; break;
+                case 'b': out += '\b'; break;
+                case 'f': out += '\f'; break;
+                case '"': case '\\': case '/': out += c; break;
+                case 'u': {
+                    uint32_t cp = 0;
+                    if (!hex4(cp)) return false;
+                    // a surrogate pair is one character; half of one is not
+                    if (cp >= 0xDC00 && cp < 0xE000) return false;
+                    if (cp >= 0xD800 && cp < 0xDC00) {
+                        uint32_t low = 0;
+                        if (end - p < 6 || p[0] != '\\' || p[1] != 'u') return false;
+                        p += 2;
+                        if (!hex4(low) || low < 0xDC00 || low >= 0xE000) return false;
+                        cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                    }
+                    putUtf8(out, cp);
+                    break;
+                }
+                default: return false;
+            }
+        }
+        return eat('"');
+    }
+
+    bool number(string& out) {
+        skip();
+        const char* start = p;
+        while (p < end && (isdigit(uint8_t(*p)) || (*p && strchr("+-.eE", *p)))) p++;
+        out.assign(start, p);
+        return p > start;
+    }
+
+    bool parse() {
+        if (!eat('{')) return false;
+        if (eat('}')) return trailing();
+        do {
+            string key, value;
+            if (!str(key) || !eat(':')) return false;
+            skip();
+            if (p < end && *p == '[') {
+                p++;
+                vector<string>& items = arrays[key];
+                if (!eat(']')) {
+                    do {
+                        if (!str(value)) return false;
+                        items.push_back(value);
+                    } while (eat(','));
+                    if (!eat(']')) return false;
+                }
+            } else if (p < end && *p == '"') {
+                if (!str(value)) return false;
+                scalars[key] = value;
+            } else {
+                if (!number(value)) return false;
+                scalars[key] = value;
+            }
+        } while (eat(','));
+        return eat('}') && trailing();
+    }
+
+    bool trailing() {
+        skip();
+        return p == end;
+    }
+};
+
+void parseImportJson(string_view line, ImportRow& row) {
+    JsonLine json(line);
+    if (!json.parse()) {
+        row.error = "JSON-e namotabar";
+        return;
+    }
+    auto& s = json.scalars;
+    if (!parseImportType(s["type"], row.type)) {
+        row.error = "noe-e soal bayad MCQ, SA ya DESC bashad";
+        return;
+    }
+    row.code = s["code"];
+    row.text = s["text"];
+    row.answer = s["answer"];
+    row.options = json.arrays["options"];
+    if (!parseImportNumber(s["positive"], row.positive)) row.error = "nomre-ye mosbat adad nist";
+    else if (row.type != QuestionType::DESC && s.count("negative") && !parseImportNumber(s["negative"], row.negative))
+    row.error = "nomre-ye manfi adad nist";
+    else if (row.type == QuestionType::MCQ && !parseImportCorrect(s["correct"], row.correct))
+    row.error = "shomare gozine dorost adad nist";
+}
+
+string validateImportRow(const ImportRow& row) {
+    if (row.code.empty() || row.code.find_first_of(" \t") != string::npos) return "code-e azmon khali ast ya fasele darad";
+    if (row.text.empty()) return "matn-e soal khali ast";
+    if (row.type == QuestionType::MCQ) {
+        if (row.options.size() != 4) return "soal-e 4-gozine-i bayad 4 gozine dashte bashad, " + to_string(row.options.size()) + " dade shod";
+        if (row.correct < 1 || row.correct > 4) return "shomare gozine dorost bayad beyn 1 ta 4 bashad";
+    }
+    if (row.type == QuestionType::SA && (row.answer.empty() || row.answer.find_first_of(" \t") != string::npos))
+    return "javab-e dorost bayad yek kalame ya adad bashad";
+    return "";
+}
+
+Question* makeImportedQuestion(const ImportRow& row) {
+    switch (row.type) {
+        case QuestionType::MCQ:
+        return dataArena.make<MultipleChoiceQuestion>(row.text, row.positive, row.negative, row.options, row.correct - 1);
+        case QuestionType::SA:
+        return dataArena.make<ShortAnswerQuestion>(row.text, row.positive, row.negative, row.answer);
+        default:
+        return dataArena.make<DescriptiveQuestion>(row.text, row.positive, row.answer);
+    }
+}
+
+ImportReport importExams(Teacher* owner, const string& filename) {
+    METRIC_TIMER(TIMER_IMPORT_EXAMS);
+    auto start = chrono::steady_clock::now();
+    ImportReport report;
+    string data;
+    if (!readWholeFile(filename, data)) {
+        cout << "File " << filename << " baz nashod.\n";
+        return report;
+    }
+
+    // blank lines, # comments and a CSV header line are skipped
+    vector<pair<size_t, string_view>> lines;
+    const char* p = data.data();
+    const char* end = p + data.size();
+    for (size_t number = 1; p < end; ++number) {
+        const char* eol = static_cast<const char*>(memchr(p, '\n', end - p));
+        if (!eol) eol = end;
+        string_view line(p, eol - p);
+        if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+        size_t first = line.find_first_not_of(" \t");
+        if (first != string_view::npos && line[first] != '#' && !(lines.empty() && line.substr(0, 5) == "code,"))
+        lines.emplace_back(number, line);
+        p = eol + 1;
+    }
+    bool json = !lines.empty() && lines[0].second[lines[0].second.find_first_not_of(" \t")] == '{';
+
+    report.rows = lines.size();
+    vector<ImportRow> rows(lines.size());
+    parallelFor(rows.size(), 1024, [&](size_t begin, size_t stop) {
+        for (size_t i = begin; i < stop; ++i) {
+            ImportRow& row = rows[i];
+            row.line = lines[i].first;
+            if (json) parseImportJson(lines[i].second, row);
+            else parseImportCsv(lines[i].second, row);
+            if (row.error.empty()) row.error = validateImportRow(row);
+        }
+    });
+
+    // exams in order of first appearance; a code that is already taken
+    // fails the first row that uses it
+    vector<pair<string_view, vector<size_t>>> exams;
+    unordered_map<string_view, size_t> examOf;
+    unordered_set<string_view> taken;
+    for (size_t i = 0; i < rows.size(); ++i) {
+        ImportRow& row = rows[i];
+        if (row.error.empty() && !taken.count(row.code)) {
+            auto it = examOf.find(row.code);
+            if (it != examOf.end()) {
+                exams[it->second].second.push_back(i);
+            } else if (lookupExam(row.code)) {
+                row.error = "code-e azmon " + row.code + " ghablan estefade shode ast";
+                taken.insert(row.code);
+            } else {
+                examOf.emplace(row.code, exams.size());
+                exams.push_back({row.code, {i}});
+            }
+        }
+        if (!row.error.empty()) report.errors.push_back({row.line, row.error});
+    }
+
+    if (report.errors.empty() && !exams.empty()) {
+        // one journal record for the lot, so a replay applies all or nothing too
+        BinaryWriter rec;
+        rec.str(owner->id);
+        rec.u32(exams.size());
+        owner->exams.reserve(owner->exams.size() + exams.size());
+        for (auto& exam : exams) {
+            vector<Question*> questions;
+            questions.reserve(exam.second.size());
+            for (size_t i : exam.second) questions.push_back(makeImportedQuestion(rows[i]));
+            string code(exam.first);
+            owner->publishExam(code, questions);
+            writeExam(rec, code, questions);
+            report.questions += questions.size();
+        }
+        journal.append(JOURNAL_IMPORT_EXAMS, rec);
+        journal.sync();
+        report.exams = exams.size();
+        report.committed = true;
+        METRIC_COUNT(COUNTER_IMPORTED_QUESTIONS, report.questions);
+    }
+    report.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    const size_t shown = 20;
+    for (size_t i = 0; i < report.errors.size() && i < shown; ++i)
+    cerr << "Khat " << report.errors[i].first << ": " << report.errors[i].second << ".\n";
+    if (report.errors.size() > shown) cerr << "... va " << report.errors.size() - shown << " khata-ye digar.\n";
+
+    if (report.committed) {
+        cout << report.exams << " azmon ba " << report.questions << " soal az " << report.rows << " khat dar "
+        << report.seconds << " s import shod (" << size_t(report.rows / max(report.seconds, 1e-9)) << " khat/s).\n";
+    } else if (report.errors.empty()) {
+        cout << "Hich soali dar " << filename << " nabood.\n";
+    } else {
+        cout << report.errors.size() << " khat az " << report.rows << " khat namotabar ast; hich azmoni import nashod.\n";
+    }
+    return report;
+}
+
+vector<pair<string, double>> metricGauges() {
+    vector<pair<string, double>> gauges;
+    {
+        lock_guard<mutex> guard(statsCache.lock);
+        gauges.push_back({"stats_cache_hits", double(statsCache.hits)});
+        gauges.push_back({"stats_cache_misses", double(statsCache.misses)});
+        gauges.push_back({"stats_cache_invalidations", double(statsCache.invalidations)});
+    }
+    {
+        lock_guard<mutex> guard(gradeSink.lock);
+        gauges.push_back({"grade_sink_records", double(gradeSink.records)});
+        gauges.push_back({"grade_sink_bytes", double(gradeSink.bytes)});
+        gauges.push_back({"grade_sink_flushes", double(gradeSink.flushes)});
+        gauges.push_back({"grade_sink_flush_seconds", gradeSink.totalFlushMs / 1000});
+        gauges.push_back({"grade_sink_max_flush_seconds", gradeSink.maxFlushMs / 1000});
+    }
+    uint64_t completed = submissions.completed.load();
+    gauges.push_back({"pipeline_in_flight", double(submissions.submitted.load() - completed)});
+    for (auto stage : {make_pair("grade", &submissions.toGrade), make_pair("persist", &submissions.toPersist), make_pair("render", &submissions.toRender)}) {
+        gauges.push_back({string("pipeline_") + stage.first + "_queue_depth", double(stage.second->depth())});
+        gauges.push_back({string("pipeline_") + stage.first + "_queue_max_depth", double(stage.second->maxDepth.load())});
+    }
+    gauges.push_back({"attempts_held", double(attempts.size())});
+    gauges.push_back({"arena_objects", double(dataArena.objectCount())});
+    gauges.push_back({"arena_bytes_used", double(dataArena.sum(&ObjectArena::bytesUsed))});
+    gauges.push_back({"arena_bytes_reserved", double(dataArena.sum(&ObjectArena::bytesReserved))});
+    gauges.push_back({"symbols", double(symbols.size())});
+    return gauges;
+}
+
+double bucketBound(size_t b) {
+    return double(uint64_t(1) << b) / 1e6;
+}
+
+void writeMetricsPrometheus(ostream& out) {
+    MetricRegistry::Totals t = metrics.totals();
+    for (size_t i = 0; i < TIMER_COUNT; ++i) {
+        string name = string("exam_") + TIMER_NAMES[i] + "_seconds";
+        out << "# TYPE " << name << " histogram\n";
+        uint64_t cumulative = 0;
+        for (size_t b = 0; b < METRIC_BUCKETS; ++b) {
+            cumulative += t.timerBuckets[i][b];
+            out << name << "_bucket{le=\"";
+            if (b + 1 < METRIC_BUCKETS) out << bucketBound(b);
+            else out << "+Inf";
+            out << "\"} " << cumulative << "\n";
+        }
+        out << name << "_sum " << t.timerNanos[i] / 1e9 << "\n";
+        out << name << "_count " << t.timerCount[i] << "\n";
+    }
+    for (size_t i = 0; i < COUNTER_COUNT; ++i) {
+        string name = string("exam_") + COUNTER_NAMES[i] + "_total";
+        out << "# TYPE " << name << " counter\n" << name << " " << t.counters[i] << "\n";
+    }
+    for (auto& g : metricGauges()) {
+        string name = "exam_" + g.first;
+        out << "# TYPE " << name << " gauge\n" << name << " " << g.second << "\n";
+    }
+}
+
+void writeMetricsJson(ostream& out) {
+    MetricRegistry::Totals t = metrics.totals();
+    out << "{\n  \"bucket_upper_bounds_seconds\": [";
+    for (size_t b = 0; b + 1 < METRIC_BUCKETS; ++b) out << (b ? ", " : "") << bucketBound(b);
+    out << "],\n  \"timers\": {";
+    for (size_t i = 0; i < TIMER_COUNT; ++i) {
+        out << (i ? "," : "") << "\n    \"" << TIMER_NAMES[i] << "\": {\"count\": " << t.timerCount[i]
+        << ", \"sum_seconds\": " << t.timerNanos[i] / 1e9 << ", \"buckets\": [";
+        for (size_t b = 0; b < METRIC_BUCKETS; ++b) out << (b ? ", " : "") << t.timerBuckets[i][b];
+        out << "]}";
+    }
+    out << "\n  },\n  \"counters\": {";
+    for (size_t i = 0; i < COUNTER_COUNT; ++i)
+    out << (i ? "," : "") << "\n    \"" << COUNTER_NAMES[i] << "\": " << t.counters[i];
+    out << "\n  },\n  \"gauges\": {";
+    vector<pair<string, double>> gauges = metricGauges();
+    for (size_t i = 0; i < gauges.size(); ++i)
+    out << (i ? "," : "") << "\n    \"" << gauges[i].first << "\": " << gauges[i].second;
+    out << "\n  }\n}\n";
+}